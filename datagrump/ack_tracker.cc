@@ -0,0 +1,75 @@
+#include <algorithm>
+
+#include "ack_tracker.hh"
+
+using namespace std;
+
+AckTracker::AckTracker( const size_t capacity )
+  : cumulative_ack_( 0 ), selectively_acked_( capacity )
+{}
+
+/* mark [first, last) as acked, returning how many weren't already */
+uint64_t AckTracker::mark_acked( const uint64_t first, const uint64_t last,
+				 const Callback & callback )
+{
+  uint64_t newly_acked = 0;
+
+  for ( uint64_t seqno = max( first, cumulative_ack_ ); seqno < last; seqno++ ) {
+    if ( not selectively_acked_.find( seqno ) ) {
+      selectively_acked_.insert( seqno ) = true;
+      newly_acked++;
+      callback( seqno );
+    }
+  }
+
+  fold();
+
+  return newly_acked;
+}
+
+/* fold anything now contiguous into the cumulative ack */
+void AckTracker::fold( void )
+{
+  while ( selectively_acked_.find( cumulative_ack_ ) ) {
+    selectively_acked_.erase( cumulative_ack_ );
+    cumulative_ack_++;
+  }
+}
+
+uint64_t AckTracker::acked( const ContestMessage::AckBlock & block, const Callback & callback )
+{
+  uint64_t newly_acked = 0;
+
+  /* everything below the receiver's cumulative ack */
+  for ( ; cumulative_ack_ < block.cumulative_ack; cumulative_ack_++ ) {
+    if ( selectively_acked_.find( cumulative_ack_ ) ) {
+      selectively_acked_.erase( cumulative_ack_ );
+    } else {
+      newly_acked++;
+      callback( cumulative_ack_ );
+    }
+  }
+
+  fold();
+
+  for ( const auto & range : block.ranges ) {
+    newly_acked += mark_acked( range.first, range.second, callback );
+  }
+
+  return newly_acked;
+}
+
+uint64_t AckTracker::acked( const uint64_t sequence_number, const Callback & callback )
+{
+  return mark_acked( sequence_number, sequence_number + 1, callback );
+}
+
+void AckTracker::give_up( const uint64_t sequence_number )
+{
+  mark_acked( sequence_number, sequence_number + 1, [] ( const uint64_t ) {} );
+}
+
+bool AckTracker::is_acked( const uint64_t sequence_number ) const
+{
+  return sequence_number < cumulative_ack_ or selectively_acked_.find( sequence_number );
+}
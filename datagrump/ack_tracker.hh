@@ -0,0 +1,49 @@
+#ifndef ACK_TRACKER_HH
+#define ACK_TRACKER_HH
+
+#include <cstdint>
+#include <functional>
+
+#include "contest_message.hh"
+#include "sequence_ring.hh"
+
+/* The sender's side of cumulative acks: which datagrams the receiver
+   has reported, so each ack can be turned into a count of datagrams
+   it newly covers (acks may be lost, reordered, or overlap) */
+
+class AckTracker
+{
+private:
+  uint64_t cumulative_ack_; /* every datagram before this has been acked */
+  SequenceRing<bool> selectively_acked_; /* acked datagrams above cumulative_ack_ */
+
+public:
+  /* called with each datagram an ack newly covers */
+  typedef std::function<void(const uint64_t)> Callback;
+
+private:
+  uint64_t mark_acked( const uint64_t first, const uint64_t last, const Callback & callback );
+  void fold( void );
+
+public:
+  AckTracker( const size_t capacity );
+
+  /* an ack with an AckBlock: returns how many datagrams it newly covers */
+  uint64_t acked( const ContestMessage::AckBlock & block,
+		  const Callback & callback = [] ( const uint64_t ) {} );
+
+  /* an ack of a single datagram */
+  uint64_t acked( const uint64_t sequence_number,
+		  const Callback & callback = [] ( const uint64_t ) {} );
+
+  /* a datagram that will never be acked (lost, and not retransmitted):
+     let the cumulative ack move past it without counting it */
+  void give_up( const uint64_t sequence_number );
+
+  uint64_t cumulative_ack( void ) const { return cumulative_ack_; }
+
+  /* has this datagram been acked? */
+  bool is_acked( const uint64_t sequence_number ) const;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <limits>
+
+#include "aimd_controller.hh"
+
+using namespace std;
+
+/* RTT to assume before the first sample, in microseconds */
+static const uint64_t INITIAL_RTT = 100 * 1000;
+
+AIMDController::AIMDController( const bool debug, const ControllerParams & params )
+  : Controller( debug ),
+    additive_increase_( params.get( "additive_increase", 1 ) ),
+    multiplicative_decrease_( params.get( "multiplicative_decrease", .5 ) ),
+    delay_threshold_( params.get( "delay_threshold_ms", 50 ) * 1000 ),
+    min_window_( params.get( "min_window", 2 ) ),
+    rtt_(),
+    window_( params.get( "initial_window", 10 ) ),
+    slow_start_threshold_( numeric_limits<double>::max() ),
+    recovery_end_( 0 )
+{}
+
+unsigned int AIMDController::window_size( void )
+{
+  return window_;
+}
+
+void AIMDController::ack_received( const AckEvent & ack,
+				   const uint64_t next_sequence_number )
+{
+  const uint64_t rtt = max<uint64_t>( ack.timestamp_ack_received - ack.send_timestamp_acked, 1 );
+  rtt_.update( rtt );
+
+  const bool congested = rtt > rtt_.min( INITIAL_RTT ) + delay_threshold_;
+
+  if ( congested and ack.sequence_number_acked >= recovery_end_ ) {
+    /* back off once for everything that was in flight */
+    window_ = max( window_ * multiplicative_decrease_, min_window_ );
+    slow_start_threshold_ = window_;
+    recovery_end_ = next_sequence_number;
+  } else if ( not congested ) {
+    if ( window_ < slow_start_threshold_ ) {
+      window_ += ack.datagrams_acked;
+    } else {
+      window_ += ack.datagrams_acked * additive_increase_ / window_;
+    }
+  }
+
+  Controller::ack_received( ack, next_sequence_number );
+}
+
+void AIMDController::datagrams_lost( const LossEvent & loss,
+				     const uint64_t next_sequence_number )
+{
+  if ( loss.timeout ) {
+    /* start over from slow start, as Reno does after a retransmission timeout */
+    slow_start_threshold_ = max( window_ * multiplicative_decrease_, min_window_ );
+    window_ = min_window_;
+    recovery_end_ = next_sequence_number;
+  } else if ( loss.largest_lost >= recovery_end_ ) {
+    window_ = max( window_ * multiplicative_decrease_, min_window_ );
+    slow_start_threshold_ = window_;
+    recovery_end_ = next_sequence_number;
+  }
+
+  Controller::datagrams_lost( loss, next_sequence_number );
+}
+
+/* one window per smoothed RTT */
+double AIMDController::pacing_rate( void )
+{
+  return window_ / (rtt_.smoothed( INITIAL_RTT ) / 1000.0);
+}
@@ -0,0 +1,44 @@
+#ifndef AIMD_CONTROLLER_HH
+#define AIMD_CONTROLLER_HH
+
+#include <cstdint>
+
+#include "controller.hh"
+#include "rtt_estimator.hh"
+
+/* Slow start, then additive increase and multiplicative decrease
+   (in the style of TCP Reno). Congestion is signalled by a loss or by
+   the RTT rising delay_threshold_ms above the minimum, at most once per
+   window; a retransmission timeout goes back to slow start. */
+
+class AIMDController : public Controller
+{
+private:
+  /* Tunable parameters */
+  double additive_increase_;      /* datagrams per RTT */
+  double multiplicative_decrease_;
+  uint64_t delay_threshold_;      /* us */
+  double min_window_;             /* datagrams */
+
+  RTTEstimator rtt_;
+  double window_;                 /* datagrams */
+  double slow_start_threshold_;   /* datagrams */
+
+  /* no more decreases until this datagram is acked */
+  uint64_t recovery_end_;
+
+public:
+  AIMDController( const bool debug, const ControllerParams & params );
+
+  unsigned int window_size( void ) override;
+
+  void ack_received( const AckEvent & ack,
+		     const uint64_t next_sequence_number ) override;
+
+  void datagrams_lost( const LossEvent & loss,
+		       const uint64_t next_sequence_number ) override;
+
+  double pacing_rate( void ) override;
+};
+
+#endif
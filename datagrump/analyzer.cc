@@ -0,0 +1,152 @@
+/* summarizes a mahimahi-format link log (a fast, native mm-throughput-graph) */
+
+#include <cstdlib>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_descriptor.hh"
+#include "log_analysis.hh"
+#include "util.hh"
+
+using namespace std;
+
+enum class Format { Text, JSON, CSV };
+
+/* the columns (and JSON fields) of a summary */
+static void write_stats( const Format format, const LinkStats & stats,
+			 const uint64_t duration_ms )
+{
+  const double capacity = LinkStats::rate_mbps( stats.capacity_bytes, duration_ms );
+  const double throughput = LinkStats::rate_mbps( stats.departed_bytes, duration_ms );
+  const double utilization = capacity > 0 ? throughput / capacity : 0;
+  const uint64_t delay_95th = stats.queueing_delay.quantile( .95 );
+
+  switch ( format ) {
+  case Format::Text:
+    cout << "Duration: " << duration_ms / 1000.0 << " s" << endl
+	 << "Average capacity: " << capacity << " Mbits/s" << endl
+	 << "Average throughput: " << throughput << " Mbits/s ("
+	 << 100 * utilization << "% utilization)" << endl
+	 << "95th percentile per-packet queueing delay: " << delay_95th << " ms" << endl
+	 << "Mean per-packet queueing delay: " << stats.queueing_delay.mean() << " ms" << endl
+	 << "Packets: " << stats.arrived_packets << " arrived, "
+	 << stats.departed_packets << " departed, "
+	 << stats.dropped_packets << " dropped" << endl;
+    break;
+  case Format::JSON:
+    cout << "{\"duration_ms\": " << duration_ms
+	 << ", \"capacity_mbps\": " << capacity
+	 << ", \"throughput_mbps\": " << throughput
+	 << ", \"utilization\": " << utilization
+	 << ", \"queueing_delay_95th_ms\": " << delay_95th
+	 << ", \"queueing_delay_mean_ms\": " << stats.queueing_delay.mean()
+	 << ", \"arrived_packets\": " << stats.arrived_packets
+	 << ", \"departed_packets\": " << stats.departed_packets
+	 << ", \"dropped_packets\": " << stats.dropped_packets << "}";
+    break;
+  case Format::CSV:
+    cout << duration_ms << "," << capacity << "," << throughput << "," << utilization
+	 << "," << delay_95th << "," << stats.queueing_delay.mean()
+	 << "," << stats.arrived_packets << "," << stats.departed_packets
+	 << "," << stats.dropped_packets << endl;
+    break;
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+   /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  Format format = Format::Text;
+  uint64_t interval_ms = 0;
+  bool usage_error = argc < 2;
+
+  for ( int i = 2; i < argc; i++ ) {
+    const string option = argv[ i ];
+    if ( option == "format=text" ) {
+      format = Format::Text;
+    } else if ( option == "format=json" ) {
+      format = Format::JSON;
+    } else if ( option == "format=csv" ) {
+      format = Format::CSV;
+    } else if ( option.compare( 0, 9, "interval=" ) == 0 ) {
+      try {
+	interval_ms = stoull( option.substr( 9 ) );
+      } catch ( const logic_error & ) { /* stoull failed */
+	usage_error = true;
+      }
+    } else {
+      usage_error = true;
+    }
+  }
+
+  if ( usage_error or (interval_ms and format == Format::Text) ) {
+    cerr << "Usage: " << argv[ 0 ] << " LOG|- [format=text|json|csv] [interval=MS]" << endl
+	 << "(intervals need JSON or CSV output)" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const string filename = argv[ 1 ];
+    FileDescriptor log( filename == "-" ? STDIN_FILENO
+			: SystemCall( "open " + filename,
+				      open( filename.c_str(), O_RDONLY | O_CLOEXEC ) ) );
+
+    if ( format == Format::CSV ) {
+      cout << "start_ms,duration_ms,capacity_mbps,throughput_mbps,utilization,"
+	   << "queueing_delay_95th_ms,queueing_delay_mean_ms,"
+	   << "arrived_packets,departed_packets,dropped_packets" << endl;
+    } else if ( format == Format::JSON ) {
+      cout << "{";
+      if ( interval_ms ) {
+	cout << "\"intervals\": [";
+      }
+    }
+
+    /* each interval is written out as soon as it's over */
+    bool first_interval = true;
+    LogAnalysis analysis( interval_ms, [&] ( const LogAnalysis::Interval & interval ) {
+	if ( format == Format::CSV ) {
+	  cout << interval.start_ms << ",";
+	} else {
+	  cout << (first_interval ? "" : ",") << "\n  {\"start_ms\": " << interval.start_ms
+	       << ", \"stats\": ";
+	}
+	write_stats( format, interval.stats, interval.duration_ms );
+	if ( format == Format::JSON ) {
+	  cout << "}";
+	}
+	first_interval = false;
+      } );
+
+    while ( not log.eof() ) {
+      analysis.parse( log.read() );
+    }
+    analysis.finish();
+
+    switch ( format ) {
+    case Format::Text:
+      write_stats( format, analysis.totals(), analysis.duration_ms() );
+      break;
+    case Format::JSON:
+      cout << (interval_ms ? "\n],\n" : "") << "\"summary\": ";
+      write_stats( format, analysis.totals(), analysis.duration_ms() );
+      cout << "}" << endl;
+      break;
+    case Format::CSV:
+      cout << "all,";
+      write_stats( format, analysis.totals(), analysis.duration_ms() );
+      break;
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
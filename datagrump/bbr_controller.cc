@@ -0,0 +1,334 @@
+#include <algorithm>
+
+#include "bbr_controller.hh"
+
+using namespace std;
+
+/* Most datagrams we expect to have in flight at once */
+static const size_t MAX_IN_FLIGHT = 16384;
+
+/* PROBE_BW: probe for more bandwidth for a round, drain what that
+   queued for a round, then cruise for six */
+static const double PACING_GAIN_CYCLE[] = { 1.25, .75, 1, 1, 1, 1, 1, 1 };
+static const unsigned int CYCLE_LENGTH = sizeof( PACING_GAIN_CYCLE ) / sizeof( double );
+
+/* STARTUP ends once three rounds in a row fail to grow the bandwidth by 25% */
+static const double FULL_BW_GROWTH = 1.25;
+static const unsigned int FULL_BW_ROUNDS = 3;
+
+/* rounds over which to remember the largest ack aggregate */
+static const uint64_t EXTRA_ACKED_ROUNDS = 5;
+
+/* the largest ack aggregate allowed for, in ms at the bandwidth estimate
+   (Linux's bbr_extra_acked_max_us), so it can't ratchet the window up */
+static const double EXTRA_ACKED_MAX_MS = 100;
+
+BBRController::BBRController( const bool debug, const ControllerParams & params )
+  : Controller( debug ),
+    high_gain_( params.get( "high_gain", 2.885 ) ), /* 2 / ln 2: doubles every round */
+    cwnd_gain_( params.get( "cwnd_gain", 2 ) ),
+    extra_acked_gain_( params.get( "extra_acked_gain", 1 ) ),
+    bw_rounds_( params.get( "bw_rounds", 10 ) ),
+    min_rtt_window_( params.get( "min_rtt_window_ms", 10000 ) * 1000 ),
+    probe_rtt_time_( params.get( "probe_rtt_ms", 200 ) * 1000 ),
+    min_window_( params.get( "min_window", 4 ) ),
+    initial_window_( params.get( "initial_window", 10 ) ),
+    state_( ControllerState::Startup ),
+    delivery_rate_( MAX_IN_FLIGHT ),
+    bw_( bw_rounds_ ),
+    min_rtt_( 0 ),
+    min_rtt_stamp_( 0 ),
+    window_( initial_window_ ),
+    prior_window_( 0 ),
+    pacing_gain_( high_gain_ ),
+    pacing_rate_( 0 ),
+    filled_pipe_( false ),
+    full_bw_( 0 ),
+    full_bw_rounds_( 0 ),
+    cycle_index_( 0 ),
+    cycle_stamp_( 0 ),
+    cycle_seed_( params.get( "seed", 1 ) ),
+    lost_since_ack_( false ),
+    probe_rtt_done_stamp_( 0 ),
+    probe_rtt_round_done_( false ),
+    ack_epoch_start_( 0 ),
+    ack_epoch_acked_( 0 ),
+    extra_acked_( EXTRA_ACKED_ROUNDS ),
+    last_send_( 0 ),
+    window_full_( false )
+{
+  update_pacing_rate();
+}
+
+/* gain x the bandwidth-delay product, in datagrams */
+double BBRController::bdp( const double gain ) const
+{
+  if ( min_rtt_ == 0 or bw_.empty() ) {
+    return initial_window_;
+  }
+
+  return gain * bandwidth() * min_rtt_ / 1000.0;
+}
+
+void BBRController::enter( const ControllerState state, const uint64_t now )
+{
+  state_ = state;
+
+  switch ( state ) {
+  case ControllerState::Startup:
+    pacing_gain_ = high_gain_;
+    break;
+  case ControllerState::Drain:
+    pacing_gain_ = 1 / high_gain_;
+    break;
+  case ControllerState::ProbeBW:
+    /* start in a random phase, other than the one that drains */
+    cycle_seed_ = cycle_seed_ * 1103515245 + 12345;
+    cycle_index_ = (cycle_seed_ >> 16) % (CYCLE_LENGTH - 1);
+    cycle_index_ += cycle_index_ ? 1 : 0;
+    cycle_stamp_ = now;
+    pacing_gain_ = PACING_GAIN_CYCLE[ cycle_index_ ];
+    break;
+  case ControllerState::ProbeRTT:
+    pacing_gain_ = 1;
+    probe_rtt_done_stamp_ = 0;
+    probe_rtt_round_done_ = false;
+    break;
+  default:
+    break;
+  }
+
+  record_state( state );
+}
+
+/* the bandwidth is the fastest recent delivery rate (a slower one
+   while the sender held back says nothing about the path) */
+void BBRController::update_bandwidth( const RateSample & sample )
+{
+  if ( not sample.valid ) {
+    return;
+  }
+
+  const double rate = sample.datagrams_per_ms();
+  if ( not sample.app_limited or rate >= bandwidth() ) {
+    bw_.update( rate, delivery_rate_.round_count() );
+  }
+}
+
+/* how far acks have run ahead of the bandwidth estimate since they
+   last fell behind it: the window needs that much slack to keep
+   sending while acks are held back and released in bursts */
+void BBRController::update_ack_aggregation( const uint64_t acked, const uint64_t now )
+{
+  if ( bw_.empty() ) {
+    return;
+  }
+
+  double expected = bandwidth() * (now - ack_epoch_start_) / 1000.0;
+  if ( ack_epoch_start_ == 0 or ack_epoch_acked_ <= expected ) {
+    ack_epoch_start_ = now;
+    ack_epoch_acked_ = 0;
+    expected = 0;
+  }
+
+  ack_epoch_acked_ += acked;
+  const double extra = min( { ack_epoch_acked_ - expected, window_,
+			       bandwidth() * EXTRA_ACKED_MAX_MS } );
+  extra_acked_.update( extra, delivery_rate_.round_count() );
+}
+
+void BBRController::check_full_pipe( const RateSample & sample )
+{
+  if ( filled_pipe_ or not sample.round_start or sample.app_limited ) {
+    return;
+  }
+
+  if ( bandwidth() >= full_bw_ * FULL_BW_GROWTH ) {
+    full_bw_ = bandwidth();
+    full_bw_rounds_ = 0;
+    return;
+  }
+
+  if ( ++full_bw_rounds_ >= FULL_BW_ROUNDS ) {
+    filled_pipe_ = true;
+  }
+}
+
+void BBRController::check_drain( const uint64_t now )
+{
+  if ( state_ == ControllerState::Startup and filled_pipe_ ) {
+    enter( ControllerState::Drain, now );
+  }
+
+  if ( state_ == ControllerState::Drain and delivery_rate_.in_flight() <= bdp( 1 ) ) {
+    enter( ControllerState::ProbeBW, now );
+  }
+}
+
+/* move on to the next phase after a min RTT (probing until the queue
+   it builds shows up, draining until that queue is gone) */
+void BBRController::update_gain_cycle( const uint64_t now )
+{
+  if ( state_ != ControllerState::ProbeBW ) {
+    return;
+  }
+
+  const bool full_length = now - cycle_stamp_ > min_rtt_;
+  const uint64_t in_flight = delivery_rate_.in_flight();
+
+  bool next_phase = full_length;
+  if ( pacing_gain_ > 1 ) {
+    next_phase = full_length and (lost_since_ack_ or in_flight >= bdp( pacing_gain_ ));
+  } else if ( pacing_gain_ < 1 ) {
+    next_phase = full_length or in_flight <= bdp( 1 );
+  }
+
+  if ( next_phase ) {
+    cycle_index_ = (cycle_index_ + 1) % CYCLE_LENGTH;
+    cycle_stamp_ = now;
+    pacing_gain_ = PACING_GAIN_CYCLE[ cycle_index_ ];
+  }
+}
+
+/* keep the min RTT fresh, going to PROBE_RTT to remeasure it when it goes stale */
+void BBRController::update_min_rtt( const uint64_t rtt, const bool round_start,
+				    const uint64_t now )
+{
+  const bool expired = min_rtt_ and now > min_rtt_stamp_ + min_rtt_window_;
+  if ( min_rtt_ == 0 or rtt <= min_rtt_ or expired ) {
+    min_rtt_ = rtt;
+    min_rtt_stamp_ = now;
+  }
+
+  if ( expired and state_ != ControllerState::ProbeRTT ) {
+    prior_window_ = window_;
+    enter( ControllerState::ProbeRTT, now );
+  }
+
+  if ( state_ != ControllerState::ProbeRTT ) {
+    return;
+  }
+
+  /* hold in-flight down for probe_rtt_time and at least a round */
+  if ( probe_rtt_done_stamp_ == 0 ) {
+    if ( delivery_rate_.in_flight() <= min_window_ ) {
+      probe_rtt_done_stamp_ = now + probe_rtt_time_;
+    }
+    return;
+  }
+
+  probe_rtt_round_done_ = probe_rtt_round_done_ or round_start;
+  if ( probe_rtt_round_done_ and now >= probe_rtt_done_stamp_ ) {
+    min_rtt_stamp_ = now;
+    window_ = max( window_, prior_window_ );
+    if ( filled_pipe_ ) {
+      enter( ControllerState::ProbeBW, now );
+    } else {
+      enter( ControllerState::Startup, now );
+    }
+  }
+}
+
+/* pace at a gain times the bandwidth (only ever faster until the pipe is full) */
+void BBRController::update_pacing_rate( void )
+{
+  const double rtt_ms = min_rtt_ ? min_rtt_ / 1000.0 : 1;
+  const double rate = pacing_gain_ * (bw_.empty() ? initial_window_ / rtt_ms : bandwidth());
+
+  if ( filled_pipe_ or rate > pacing_rate_ ) {
+    pacing_rate_ = rate;
+  }
+}
+
+/* grow toward cwnd_gain BDPs plus the ack-aggregation slack (in DRAIN,
+   toward one BDP, so the queue drains even if the sender doesn't pace) */
+void BBRController::update_window( const uint64_t acked )
+{
+  const double gain = state_ == ControllerState::Startup ? high_gain_
+    : state_ == ControllerState::Drain ? 1 : cwnd_gain_;
+  const double target = bdp( gain )
+    + (extra_acked_.empty() ? 0 : extra_acked_gain_ * extra_acked_.best());
+
+  if ( filled_pipe_ ) {
+    window_ = min( window_ + acked, target );
+  } else if ( window_ < target or delivery_rate_.delivered_datagrams() < initial_window_ ) {
+    window_ += acked;
+  }
+
+  window_ = max( window_, min_window_ );
+
+  if ( state_ == ControllerState::ProbeRTT ) {
+    window_ = min( window_, min_window_ );
+  }
+}
+
+unsigned int BBRController::window_size( void )
+{
+  return window_;
+}
+
+void BBRController::datagram_was_sent( const uint64_t sequence_number,
+				       const uint64_t send_timestamp,
+				       const uint64_t size )
+{
+  /* samples say nothing about the path while the window is held down, or
+     when the window had room but nothing went out for longer than pacing
+     explains (the sender had nothing to send) */
+  const uint64_t pacing_interval = pacing_rate_ > 0 ? 2000 / pacing_rate_ : 0;
+  const bool idle = last_send_ and not window_full_
+    and send_timestamp - last_send_ > max( min_rtt_, pacing_interval );
+  if ( state_ == ControllerState::ProbeRTT or idle ) {
+    delivery_rate_.set_app_limited();
+  }
+
+  delivery_rate_.sent( sequence_number, send_timestamp, size );
+  last_send_ = send_timestamp;
+  window_full_ = delivery_rate_.in_flight() >= window_;
+
+  Controller::datagram_was_sent( sequence_number, send_timestamp, size );
+}
+
+void BBRController::ack_received( const AckEvent & ack,
+				  const uint64_t next_sequence_number )
+{
+  const uint64_t now = ack.timestamp_ack_received;
+  const uint64_t rtt = max<uint64_t>( now - ack.send_timestamp_acked, 1 );
+
+  const RateSample sample = delivery_rate_.acked( ack, min_rtt_ );
+  update_bandwidth( sample );
+  update_ack_aggregation( ack.datagrams_acked, now );
+
+  update_gain_cycle( now );
+  check_full_pipe( sample );
+  check_drain( now );
+  update_min_rtt( rtt, sample.round_start, now );
+
+  update_pacing_rate();
+  update_window( ack.datagrams_acked );
+
+  lost_since_ack_ = false;
+
+  Controller::ack_received( ack, next_sequence_number );
+}
+
+/* BBR doesn't take loss as a congestion signal, except after a
+   retransmission timeout, when it starts the window over from the
+   minimum (and grows it back toward the model's target) */
+void BBRController::datagrams_lost( const LossEvent & loss,
+				    const uint64_t next_sequence_number )
+{
+  delivery_rate_.lost( loss.datagrams_lost );
+  lost_since_ack_ = true;
+
+  if ( loss.timeout ) {
+    window_ = min_window_;
+  }
+
+  Controller::datagrams_lost( loss, next_sequence_number );
+}
+
+/* datagrams per millisecond */
+double BBRController::pacing_rate( void )
+{
+  return pacing_rate_;
+}
@@ -0,0 +1,109 @@
+#ifndef BBR_CONTROLLER_HH
+#define BBR_CONTROLLER_HH
+
+#include <cstdint>
+#include <functional>
+
+#include "controller.hh"
+#include "delivery_rate.hh"
+#include "windowed_filter.hh"
+
+/* BBR (Cardwell et al., ACM Queue 2016; draft-cardwell-iccrg-bbr-congestion-control):
+   model the path as its bottleneck bandwidth (max delivery rate over the
+   last bw_rounds round trips) and round-trip propagation time (min RTT
+   over the last min_rtt_window), and pace at a gain times the bandwidth
+   with a window of cwnd_gain x the bandwidth-delay product.
+
+   STARTUP doubles the rate every round until the bandwidth stops
+   growing by 25% for three rounds, DRAIN empties the queue that built,
+   PROBE_BW cycles the pacing gain through 5/4, 3/4 and six rounds of 1,
+   and PROBE_RTT holds in-flight to four datagrams for probe_rtt_ms
+   whenever the min RTT goes stale. The window also allows for acks
+   that arrive in aggregates (Linux's extra_acked), up to 100 ms at
+   the bandwidth estimate.
+
+   The sender may not pace, so DRAIN holds the window to one BDP
+   rather than relying on the pacing rate to empty the queue. */
+
+class BBRController : public Controller
+{
+private:
+  /* Tunable parameters */
+  double high_gain_;
+  double cwnd_gain_;
+  double extra_acked_gain_;
+  uint64_t bw_rounds_;
+  uint64_t min_rtt_window_;     /* us */
+  uint64_t probe_rtt_time_;     /* us */
+  double min_window_;           /* datagrams */
+  double initial_window_;       /* datagrams */
+
+  ControllerState state_;
+
+  DeliveryRateEstimator delivery_rate_;
+  WindowedFilter<double, uint64_t> bw_;   /* datagrams/ms, by round */
+
+  uint64_t min_rtt_;            /* us (0 before the first sample) */
+  uint64_t min_rtt_stamp_;      /* when min_rtt_ was measured */
+
+  double window_;               /* datagrams */
+  double prior_window_;         /* to restore after PROBE_RTT */
+  double pacing_gain_;
+  double pacing_rate_;          /* datagrams/ms */
+
+  /* full-pipe detection in STARTUP */
+  bool filled_pipe_;
+  double full_bw_;
+  unsigned int full_bw_rounds_;
+
+  /* PROBE_BW gain cycling */
+  unsigned int cycle_index_;
+  uint64_t cycle_stamp_;
+  uint32_t cycle_seed_;       /* picks the starting phase (reproducibly) */
+  bool lost_since_ack_;
+
+  /* PROBE_RTT */
+  uint64_t probe_rtt_done_stamp_; /* 0 until in-flight has come down */
+  bool probe_rtt_round_done_;
+
+  /* ack aggregation: datagrams acked beyond what bw_ predicts */
+  uint64_t ack_epoch_start_;
+  double ack_epoch_acked_;
+  WindowedFilter<double, uint64_t> extra_acked_; /* datagrams, by round */
+
+  /* app-limited detection: did the window have room after the last send? */
+  uint64_t last_send_;          /* us (0 before the first) */
+  bool window_full_;
+
+  double bandwidth( void ) const { return bw_.empty() ? 0 : bw_.best(); }
+  double bdp( const double gain ) const;
+  void enter( const ControllerState state, const uint64_t now );
+
+  void update_bandwidth( const RateSample & sample );
+  void update_ack_aggregation( const uint64_t acked, const uint64_t now );
+  void check_full_pipe( const RateSample & sample );
+  void check_drain( const uint64_t now );
+  void update_gain_cycle( const uint64_t now );
+  void update_min_rtt( const uint64_t rtt, const bool round_start, const uint64_t now );
+  void update_pacing_rate( void );
+  void update_window( const uint64_t acked );
+
+public:
+  BBRController( const bool debug, const ControllerParams & params );
+
+  unsigned int window_size( void ) override;
+
+  void datagram_was_sent( const uint64_t sequence_number,
+			  const uint64_t send_timestamp,
+			  const uint64_t size ) override;
+
+  void ack_received( const AckEvent & ack,
+		     const uint64_t next_sequence_number ) override;
+
+  void datagrams_lost( const LossEvent & loss,
+		       const uint64_t next_sequence_number ) override;
+
+  double pacing_rate( void ) override;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include <iostream>
+
+#include "bbrish_controller.hh"
+#include "metrics.hh"
+
+using namespace std;
+
+/* Most datagrams we expect to have in flight at once
+   (older ones are forgotten if the window ever gets bigger) */
+static const size_t MAX_IN_FLIGHT = 16384;
+
+BBRishController::BBRishController( const bool debug, const ControllerParams & params )
+  : Controller( debug ),
+    gain_( params.get( "gain", 1.5 ) ),
+    pacing_gain_( params.get( "pacing_gain", 1.25 ) ),
+    bw_window_( params.get( "bw_window", 3 ) ),
+    rtt_window_( params.get( "rtt_window_ms", 3000 ) * 1000 ),
+    probe_rtt_time_( params.get( "probe_rtt_ms", 200 ) * 1000 ),
+    probe_rtt_window_( params.get( "probe_rtt_window", 4 ) ),
+    initial_bw_( params.get( "initial_bw", .15 ) ),
+    initial_rtt_( params.get( "initial_rtt_ms", 100 ) * 1000 ),
+    bw_filter_( bw_window_ ), rtt_filter_( rtt_window_ ),
+    delivered_( 0 ), packets_( MAX_IN_FLIGHT ),
+    state_(NORMAL), probe_rtt_start_(0)
+{}
+
+/* Get current window size, in datagrams */
+unsigned int BBRishController::window_size( void )
+{
+  uint64_t now = now_us();
+  if (state_ == PROBE_RTT && now - probe_rtt_start_ > probe_rtt_time_) {
+    record_state(ControllerState::Normal);
+    state_ = NORMAL;
+  }
+
+  auto rtt = get_rtt();
+
+  if (state_ == PROBE_RTT) {
+    return probe_rtt_window_;
+  } else {
+    double bdp = gain_ * (rtt / 1000.0) * get_bw();
+    // cerr << "At time " << now_us() << " window size is " << bdp << endl;
+    return bdp;
+  }
+  /*
+  unsigned int the_window_size = 50;
+
+  if ( debug_ ) {
+    cerr << "At time " << now_us()
+	 << " window size is " << the_window_size << endl;
+  }
+
+  return the_window_size;
+  */
+}
+
+/* A datagram was sent */
+void BBRishController::datagram_was_sent( const uint64_t sequence_number,
+					  const uint64_t send_timestamp,
+					  const uint64_t size )
+{
+  packet_ & packet = packets_.insert(sequence_number);
+  packet.delivered = delivered_;
+  packet.send_time = send_timestamp;
+  packet.size = size;
+  packet.app_limited = (state_ == PROBE_RTT);
+
+  Controller::datagram_was_sent( sequence_number, send_timestamp, size );
+}
+
+/* An ack was received */
+void BBRishController::ack_received( const AckEvent & ack,
+				     const uint64_t next_sequence_number )
+{
+  if (state_ == PROBE_RTT) {
+    record_state(ControllerState::Normal);
+    state_ = NORMAL;
+  }
+
+  delivered_ += ack.datagrams_acked;
+
+  // Never let a sample collapse to zero (and divide by it below).
+  uint64_t rtt = max<uint64_t>(ack.timestamp_ack_received - ack.send_timestamp_acked, 1);
+  update_rtt(rtt);
+
+  const packet_ * packet = packets_.find(ack.sequence_number_acked);
+  if (packet) {
+    double delivery_rate = double(delivered_ - packet->delivered) / (rtt / 1000.0);
+    // A capped window understates the bandwidth, so only trust it if it's higher.
+    if (!packet->app_limited || delivery_rate > get_bw()) {
+      update_bw(delivery_rate, ack.sequence_number_acked);
+    }
+    packets_.erase(ack.sequence_number_acked);
+  }
+
+  Controller::ack_received( ack, next_sequence_number );
+}
+
+/* Pace a little above the bandwidth estimate: at exactly the estimate,
+   no sample could ever exceed it */
+double BBRishController::pacing_rate( void )
+{
+  return pacing_gain_ * get_bw();
+}
+
+double BBRishController::get_bw( void )
+{
+  return bw_filter_.empty() ? initial_bw_ : bw_filter_.best();
+}
+
+void BBRishController::update_bw( const double new_bw, const uint64_t seqno )
+{
+  bw_filter_.update(new_bw, seqno);
+}
+
+uint64_t BBRishController::get_rtt( void )
+{
+  uint64_t now = now_us();
+  rtt_filter_.expire(now);
+
+  if (state_ == NORMAL && rtt_filter_.empty()) {
+    record_state(ControllerState::ProbeRTT);
+    state_ = PROBE_RTT;
+    probe_rtt_start_ = now;
+    count_event(Counter::ProbeRTTEntries);
+  }
+
+  return rtt_filter_.empty() ? initial_rtt_ : rtt_filter_.best();
+}
+
+void BBRishController::update_rtt( const uint64_t new_rtt )
+{
+  rtt_filter_.update(new_rtt, now_us());
+}
@@ -0,0 +1,69 @@
+#ifndef BBRISH_CONTROLLER_HH
+#define BBRISH_CONTROLLER_HH
+
+#include <cstdint>
+#include <functional>
+
+#include "controller.hh"
+#include "sequence_ring.hh"
+#include "windowed_filter.hh"
+
+/* Window of gain x max bandwidth x min RTT, with a ProbeRTT phase
+   whenever the min RTT sample expires (a simplified BBR) */
+
+class BBRishController : public Controller
+{
+private:
+  /* Tunable parameters */
+  double gain_;               // x BDP.
+  double pacing_gain_;        // x max bandwidth (> 1, or the estimate can't grow).
+  uint64_t bw_window_;        // pkts.
+  uint64_t rtt_window_;       // us.
+  uint64_t probe_rtt_time_;   // us.
+  unsigned int probe_rtt_window_;  // pkts.
+  double initial_bw_;         // pkts/ms.
+  uint64_t initial_rtt_;      // us.
+
+  WindowedFilter<double, uint64_t> bw_filter_;  // Max pkts/ms, by seqno.
+  WindowedFilter<uint64_t, uint64_t, std::less<uint64_t>> rtt_filter_;  // Min us, by time.
+
+  uint64_t delivered_;  // # packets.
+
+  // Send-time state of each datagram in flight, retired when acked.
+  struct packet_ {
+    uint64_t delivered;    // delivered_ when it was sent.
+    uint64_t send_time;    // us.
+    uint64_t size;         // bytes.
+    bool app_limited;      // sent while the window was held down (ProbeRTT).
+  };
+  SequenceRing<packet_> packets_;  // seqno =>.
+
+  double get_bw( void );
+  void update_bw( const double new_bw, const uint64_t seqno );
+
+  uint64_t get_rtt( void );
+  void update_rtt( const uint64_t new_rtt );
+
+  enum {
+    NORMAL,
+    PROBE_RTT,
+  } state_;
+
+  uint64_t probe_rtt_start_;  // us.
+
+public:
+  BBRishController( const bool debug, const ControllerParams & params );
+
+  unsigned int window_size( void ) override;
+
+  void datagram_was_sent( const uint64_t sequence_number,
+			  const uint64_t send_timestamp,
+			  const uint64_t size ) override;
+
+  void ack_received( const AckEvent & ack,
+		     const uint64_t next_sequence_number ) override;
+
+  double pacing_rate( void ) override;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdexcept>
+#include <cstring>
 
 #include "contest_message.hh"
 #include "timestamp.hh"
@@ -6,63 +7,91 @@
 using namespace std;
 
 /* helper to get the nth uint64_t field (in network byte order) */
-uint64_t get_header_field( const size_t n, const string & str )
+static uint64_t get_header_field( const size_t n, const char * const data )
 {
-  if ( str.size() < (n + 1) * sizeof( uint64_t ) ) {
+  uint64_t network_order;
+  memcpy( &network_order, data + n * sizeof( uint64_t ), sizeof( network_order ) );
+  return be64toh( network_order );
+}
+
+/* helper to put the nth uint64_t field (in network byte order) */
+static void put_header_field( const size_t n, char * const data, const uint64_t value )
+{
+  const uint64_t network_order = htobe64( value );
+  memcpy( data + n * sizeof( uint64_t ), &network_order, sizeof( network_order ) );
+}
+
+/* helper to make sure a datagram can hold the header */
+static const char * check_header_length( const string & str )
+{
+  if ( str.size() < ContestMessage::Header::LENGTH ) {
     throw runtime_error( "contest message too small to contain header" );
   }
 
-  const uint64_t * const data_ptr
-    = reinterpret_cast<const uint64_t *>( str.data() ) + n;
-
-  return be64toh( *data_ptr );
+  return str.data();
 }
 
 /* Parse header from wire */
 ContestMessage::Header::Header( const string & str )
-  : sequence_number( get_header_field( 0, str ) ),
-    send_timestamp( get_header_field( 1, str ) ),
-    ack_sequence_number( get_header_field( 2, str ) ),
-    ack_send_timestamp( get_header_field( 3, str ) ),
-    ack_recv_timestamp( get_header_field( 4, str ) ),
-    ack_payload_length( get_header_field( 5, str ) )
+  : sequence_number( get_header_field( 0, check_header_length( str ) ) ),
+    send_timestamp( get_header_field( 1, str.data() ) ),
+    ack_sequence_number( get_header_field( 2, str.data() ) ),
+    ack_send_timestamp( get_header_field( 3, str.data() ) ),
+    ack_recv_timestamp( get_header_field( 4, str.data() ) ),
+    ack_payload_length( get_header_field( 5, str.data() ) )
 {}
 
 /* Parse incoming message from wire */
 ContestMessage::ContestMessage( const string & str )
   : header( str ),
-    payload( str.begin() + sizeof( header ), str.end() )
+    payload( str.begin() + Header::LENGTH, str.end() )
 {}
 
 /* Fill in the send_timestamp for an outgoing message */
 void ContestMessage::set_send_timestamp( void )
 {
-  header.send_timestamp = timestamp_ms();
+  header.send_timestamp = timestamp_us();
 }
 
-/* helper to put a uint64_t field (in network byte order) */
-string put_header_field( const uint64_t n )
+/* Write wire representation of header into buffer */
+void ContestMessage::Header::serialize( char * const buffer ) const
 {
-  const uint64_t network_order = htobe64( n );
-  return string( reinterpret_cast<const char *>( &network_order ),
-		 sizeof( network_order ) );
+  put_header_field( 0, buffer, sequence_number );
+  put_header_field( 1, buffer, send_timestamp );
+  put_header_field( 2, buffer, ack_sequence_number );
+  put_header_field( 3, buffer, ack_send_timestamp );
+  put_header_field( 4, buffer, ack_recv_timestamp );
+  put_header_field( 5, buffer, ack_payload_length );
 }
 
 /* Make wire representation of header */
 string ContestMessage::Header::to_string( void ) const
 {
-  return put_header_field( sequence_number )
-    + put_header_field( send_timestamp )
-    + put_header_field( ack_sequence_number )
-    + put_header_field( ack_send_timestamp )
-    + put_header_field( ack_recv_timestamp )
-    + put_header_field( ack_payload_length );
+  string ret( LENGTH, 0 );
+  serialize( &ret[ 0 ] );
+  return ret;
 }
 
 /* Make wire representation of message */
 string ContestMessage::to_string( void ) const
 {
-  return header.to_string() + payload;
+  string ret( Header::LENGTH + payload.size(), 0 );
+  serialize( &ret[ 0 ], ret.size() );
+  return ret;
+}
+
+/* Write wire representation of message into a preallocated buffer */
+size_t ContestMessage::serialize( char * const buffer, const size_t capacity ) const
+{
+  const size_t length = Header::LENGTH + payload.size();
+  if ( capacity < length ) {
+    throw runtime_error( "buffer too small for contest message" );
+  }
+
+  header.serialize( buffer );
+  memcpy( buffer + Header::LENGTH, payload.data(), payload.size() );
+
+  return length;
 }
 
 /* Transform into an ack of the ContestMessage */
@@ -106,3 +135,111 @@ bool ContestMessage::is_ack( void ) const
 {
   return header.ack_sequence_number != uint64_t( -1 );
 }
+
+/* View of a datagram in a caller-owned buffer */
+ContestMessageView::ContestMessageView( char * const data, const size_t length )
+  : data_( data ),
+    length_( length )
+{
+  if ( length_ < ContestMessage::Header::LENGTH ) {
+    throw runtime_error( "contest message too small to contain header" );
+  }
+}
+
+uint64_t ContestMessageView::get( const size_t n ) const
+{
+  return get_header_field( n, data_ );
+}
+
+void ContestMessageView::put( const size_t n, const uint64_t value )
+{
+  put_header_field( n, data_, value );
+}
+
+/* Write a header for a new message */
+void ContestMessageView::initialize_header( const uint64_t sequence_number )
+{
+  ContestMessage::Header( sequence_number ).serialize( data_ );
+}
+
+/* Fill in the send_timestamp for an outgoing message */
+void ContestMessageView::set_send_timestamp( void )
+{
+  set_send_timestamp( timestamp_us() );
+}
+
+/* Transform into an ack of the message, in place */
+void ContestMessageView::transform_into_ack( const uint64_t sequence_number,
+					     const uint64_t recv_timestamp )
+{
+  /* ack the old sequence number and send timestamp */
+  put( 2, get( 0 ) );
+  put( 3, get( 1 ) );
+
+  /* now assign a new sequence number for the outgoing ack */
+  put( 0, sequence_number );
+
+  /* ack the other fields */
+  put( 4, recv_timestamp );
+  put( 5, payload_length() );
+
+  /* drop the payload */
+  length_ = ContestMessage::Header::LENGTH;
+}
+
+/* Is this message an ack? */
+bool ContestMessageView::is_ack( void ) const
+{
+  return ack_sequence_number() != uint64_t( -1 );
+}
+
+/* Parse an AckBlock from wire */
+ContestMessage::AckBlock::AckBlock( const char * const data, const size_t length )
+  : cumulative_ack( 0 ), datagram_count( 0 ), ranges()
+{
+  if ( length < 3 * sizeof( uint64_t ) ) {
+    throw runtime_error( "ack block too small" );
+  }
+
+  cumulative_ack = get_header_field( 0, data );
+  datagram_count = get_header_field( 1, data );
+  const uint64_t range_count = get_header_field( 2, data );
+
+  if ( range_count > MAX_RANGES or length != (3 + 2 * range_count) * sizeof( uint64_t ) ) {
+    throw runtime_error( "ack block has the wrong length for its ranges" );
+  }
+
+  for ( size_t i = 0; i < range_count; i++ ) {
+    ranges.emplace_back( get_header_field( 3 + 2 * i, data ),
+			 get_header_field( 4 + 2 * i, data ) );
+  }
+}
+
+/* Write wire representation of AckBlock */
+void ContestMessage::AckBlock::serialize( char * const buffer ) const
+{
+  if ( ranges.size() > MAX_RANGES ) {
+    throw runtime_error( "too many ranges for an ack block" );
+  }
+
+  put_header_field( 0, buffer, cumulative_ack );
+  put_header_field( 1, buffer, datagram_count );
+  put_header_field( 2, buffer, ranges.size() );
+
+  for ( size_t i = 0; i < ranges.size(); i++ ) {
+    put_header_field( 3 + 2 * i, buffer, ranges[ i ].first );
+    put_header_field( 4 + 2 * i, buffer, ranges[ i ].second );
+  }
+}
+
+ContestMessage::AckBlock ContestMessageView::ack_block( void ) const
+{
+  return ContestMessage::AckBlock( payload(), payload_length() );
+}
+
+/* Write an AckBlock after the header */
+void ContestMessageView::set_ack_block( const ContestMessage::AckBlock & block )
+{
+  block.serialize( payload() );
+  length_ = ContestMessage::Header::LENGTH + block.length();
+}
@@ -3,9 +3,12 @@
 
 #include <string>
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 struct ContestMessage
 {
+  /* (timestamps are in microseconds) */
   struct Header {
     uint64_t sequence_number;
     uint64_t send_timestamp;
@@ -23,8 +26,39 @@ struct ContestMessage
 
     /* Make wire representation of header */
     std::string to_string( void ) const;
+
+    /* Write wire representation of header into buffer (of at least LENGTH bytes) */
+    void serialize( char * const buffer ) const;
+
+    /* Size of header on the wire */
+    static const size_t LENGTH = 6 * sizeof( uint64_t );
   } header;
 
+  /* An ack that covers several datagrams carries this as its payload */
+  struct AckBlock {
+    uint64_t cumulative_ack;   /* every datagram before this one has been received */
+    uint64_t datagram_count;   /* datagrams received since the previous ack */
+
+    /* [first, last + 1) runs of datagrams received above cumulative_ack,
+       the latest arrival's first, then newest first (at most MAX_RANGES) */
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+    static const size_t MAX_RANGES = 16;
+
+    /* Parse from wire */
+    AckBlock( const char * const data, const size_t length );
+
+    AckBlock( const uint64_t s_cumulative_ack, const uint64_t s_datagram_count )
+      : cumulative_ack( s_cumulative_ack ), datagram_count( s_datagram_count ), ranges() {}
+
+    /* Size on the wire */
+    size_t length( void ) const { return (3 + 2 * ranges.size()) * sizeof( uint64_t ); }
+    static const size_t MAX_LENGTH = (3 + 2 * MAX_RANGES) * sizeof( uint64_t );
+
+    /* Write wire representation into buffer (of at least length() bytes) */
+    void serialize( char * const buffer ) const;
+  };
+
   std::string payload;
 
   /* New message */
@@ -40,6 +74,10 @@ struct ContestMessage
   /* Make wire representation of datagram */
   std::string to_string( void ) const;
 
+  /* Write wire representation of datagram into a preallocated buffer,
+     returning its length */
+  size_t serialize( char * const buffer, const size_t capacity ) const;
+
   /* Transform into an ack of the ContestMessage */
   void transform_into_ack( const uint64_t sequence_number,
 			   const uint64_t recv_timestamp );
@@ -48,4 +86,61 @@ struct ContestMessage
   bool is_ack( void ) const;
 };
 
+/* Non-owning view of a ContestMessage in a caller-owned wire buffer,
+   reading and writing the header fields in place */
+class ContestMessageView
+{
+private:
+  char * data_;
+  size_t length_;
+
+  uint64_t get( const size_t n ) const;
+  void put( const size_t n, const uint64_t value );
+
+public:
+  /* View of a datagram (must be big enough to hold the header) */
+  ContestMessageView( char * const data, const size_t length );
+
+  /* Header fields */
+  uint64_t sequence_number( void ) const { return get( 0 ); }
+  uint64_t send_timestamp( void ) const { return get( 1 ); }
+  uint64_t ack_sequence_number( void ) const { return get( 2 ); }
+  uint64_t ack_send_timestamp( void ) const { return get( 3 ); }
+  uint64_t ack_recv_timestamp( void ) const { return get( 4 ); }
+  uint64_t ack_payload_length( void ) const { return get( 5 ); }
+
+  /* Write a header for a new message */
+  void initialize_header( const uint64_t sequence_number );
+
+  void set_sequence_number( const uint64_t sequence_number ) { put( 0, sequence_number ); }
+
+  /* Fill in the send_timestamp for an outgoing datagram */
+  void set_send_timestamp( void );
+  void set_send_timestamp( const uint64_t send_timestamp ) { put( 1, send_timestamp ); }
+
+  /* Transform into an ack of the message (drops the payload) */
+  void transform_into_ack( const uint64_t sequence_number,
+			   const uint64_t recv_timestamp );
+
+  /* Is this message an ack? */
+  bool is_ack( void ) const;
+
+  /* Does this ack cover several datagrams (with an AckBlock after the header)? */
+  bool has_ack_block( void ) const { return is_ack() and payload_length() > 0; }
+  ContestMessage::AckBlock ack_block( void ) const;
+
+  /* Write an AckBlock after the header of an ack
+     (the underlying buffer must have room for it) */
+  void set_ack_block( const ContestMessage::AckBlock & block );
+
+  /* Wire representation */
+  const char * data( void ) const { return data_; }
+  size_t length( void ) const { return length_; }
+
+  /* Payload follows the header */
+  char * payload( void ) { return data_ + ContestMessage::Header::LENGTH; }
+  const char * payload( void ) const { return data_ + ContestMessage::Header::LENGTH; }
+  size_t payload_length( void ) const { return length_ - ContestMessage::Header::LENGTH; }
+};
+
 #endif /* CONTEST_MESSAGE_HH */
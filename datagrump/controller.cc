@@ -1,153 +1,222 @@
 #include <iostream>
-#include <deque>
-#include <chrono>
+#include <stdexcept>
 
 #include "controller.hh"
+#include "bbrish_controller.hh"
+#include "aimd_controller.hh"
+#include "vegas_controller.hh"
+#include "copa_controller.hh"
+#include "cubic_controller.hh"
+#include "bbr_controller.hh"
+#include "sprout_controller.hh"
 #include "timestamp.hh"
+#include "flight_recorder.hh"
 
 using namespace std;
 
-/* Default constructor */
-Controller::Controller( const bool debug )
-  : debug_( debug ), bw_filter_(), rtt_filter_(), delivered_( 0 ), packets_(),
-    sequence_number_(0), state_(NORMAL), probe_rtt_start_()
-{}
+/* set a parameter */
+void ControllerParams::set( const string & name, const string & value )
+{
+  if ( name.empty() ) {
+    throw runtime_error( "controller parameter has no name" );
+  }
+
+  values_[ name ] = value;
+}
 
-/* Get current window size, in datagrams */
-unsigned int Controller::window_size( void )
+/* set a parameter from "name=value" */
+void ControllerParams::set( const string & assignment )
 {
-  tp now = std::chrono::system_clock::now();
-  if (state_ == PROBE_RTT && now - probe_rtt_start_ > std::chrono::milliseconds(200)) {
-    cerr << "Exiting ProbeRTT" << endl;
-    state_ = NORMAL;
+  const size_t equals = assignment.find( '=' );
+  if ( equals == string::npos ) {
+    throw runtime_error( "controller parameter \"" + assignment + "\" is not name=value" );
   }
 
-  auto rtt = get_rtt();
+  set( assignment.substr( 0, equals ), assignment.substr( equals + 1 ) );
+}
+
+/* value of a numeric parameter, or default_value if it wasn't set */
+double ControllerParams::get( const string & name, const double default_value ) const
+{
+  used_.insert( name );
 
-  if (state_ == PROBE_RTT) {
-    return 4;
-  } else {
-    double bdp = double(1.5) * rtt * get_bw();
-    // cerr << "At time " << timestamp_ms() << " window size is " << bdp << endl;
-    return bdp;
+  const auto value = values_.find( name );
+  if ( value == values_.end() ) {
+    return default_value;
   }
-  /*
-  unsigned int the_window_size = 50;
 
-  if ( debug_ ) {
-    cerr << "At time " << timestamp_ms()
-	 << " window size is " << the_window_size << endl;
+  size_t parsed = 0;
+  double ret = 0;
+  try {
+    ret = stod( value->second, &parsed );
+  } catch ( const logic_error & ) {
+    parsed = 0;
+  }
+
+  if ( parsed == 0 or parsed != value->second.size() ) {
+    throw runtime_error( "controller parameter " + name + " has non-numeric value \""
+			 + value->second + "\"" );
   }
 
-  return the_window_size;
-  */
+  return ret;
 }
 
-/* A datagram was sent */
-void Controller::datagram_was_sent( const uint64_t sequence_number,
-				    /* of the sent datagram */
-				    const uint64_t send_timestamp )
-                                    /* in milliseconds */
+/* parameters that were set but never asked for */
+vector<string> ControllerParams::unused( void ) const
 {
-  /* Default: take no action */
-  packets_[sequence_number].delivered = delivered_;
-
-  if ( debug_ ) {
-    cerr << "At time " << send_timestamp
-	 << " sent datagram " << sequence_number << endl;
+  vector<string> ret;
+  for ( const auto & value : values_ ) {
+    if ( not used_.count( value.first ) ) {
+      ret.push_back( value.first );
+    }
   }
+  return ret;
 }
 
-/* An ack was received */
-void Controller::ack_received( const uint64_t sequence_number_acked,
-			       /* what sequence number was acknowledged */
-			       const uint64_t send_timestamp_acked,
-			       /* when the acknowledged datagram was sent (sender's clock) */
-			       const uint64_t recv_timestamp_acked,
-			       /* when the acknowledged datagram was received (receiver's clock)*/
-			       const uint64_t timestamp_ack_received,
-             /* when the ack was received (by sender) */
-             const uint64_t sequence_number )
+string ControllerParams::to_string( void ) const
 {
-  if (state_ == PROBE_RTT) {
-    cerr << "Exiting ProbeRTT" << endl;
-    state_ = NORMAL;
+  string ret;
+  for ( const auto & value : values_ ) {
+    if ( not ret.empty() ) {
+      ret += ",";
+    }
+    ret += value.first + "=" + value.second;
   }
+  return ret;
+}
+
+Controller::Controller( const bool debug )
+  : clock_( [] () { return timestamp_us(); } ), flow_( 0 ), debug_( debug )
+{}
+
+const char * state_name( const ControllerState state )
+{
+  static const char * const names[] = {
+    "Normal", "SlowStart", "CongestionAvoidance", "Recovery",
+    "Startup", "Drain", "ProbeBW", "ProbeRTT"
+  };
+  static_assert( sizeof( names ) / sizeof( names[ 0 ] ) == size_t( ControllerState::COUNT ),
+		 "every ControllerState needs a name" );
+
+  return state < ControllerState::COUNT ? names[ size_t( state ) ] : "unknown";
+}
 
-  delivered_++;
-  delivered_ += sequence_number * 0;
+/* The controller entered a new phase */
+void Controller::record_state( const ControllerState state )
+{
+  const uint64_t now = now_us();
 
-  uint64_t rtt = timestamp_ack_received - send_timestamp_acked;
-  update_rtt(rtt);
-  double delivery_rate = double(delivered_ - packets_[sequence_number_acked].delivered) / rtt;
-  update_bw(delivery_rate, sequence_number_acked);
+  flight_record( now, FlightEvent::State, flow_, 0, uint32_t( state ), 0 );
 
   if ( debug_ ) {
-    cerr << "At time " << timestamp_ack_received
-	 << " received ack for datagram " << sequence_number_acked
-	 << " (send @ time " << send_timestamp_acked
-	 << ", received @ time " << recv_timestamp_acked << " by receiver's clock)"
-	 << endl;
+    cerr << "At time " << now << " entered " << state_name( state ) << endl;
   }
 }
 
-/* How long to wait (in milliseconds) if there are no acks
-   before sending one more datagram */
-unsigned int Controller::timeout_ms( void )
+/* A datagram was sent */
+void Controller::datagram_was_sent( const uint64_t sequence_number,
+				    /* of the sent datagram */
+				    const uint64_t send_timestamp,
+                                    /* in microseconds */
+				    const uint64_t size )
+				    /* in bytes */
 {
-  return 200;
+  if ( debug_ ) {
+    cerr << "At time " << send_timestamp
+	 << " sent datagram " << sequence_number
+	 << " (" << size << " bytes)" << endl;
+  }
 }
 
-double Controller::get_bw( void )
+/* An ack was received */
+void Controller::ack_received( const AckEvent & ack,
+			       const uint64_t next_sequence_number )
+			       /* what the sender will send next */
 {
-  return bw_filter_.empty() ? .15 : bw_filter_.front().bw;
+  if ( debug_ ) {
+    cerr << "At time " << ack.timestamp_ack_received
+	 << " received ack for datagram " << ack.sequence_number_acked
+	 << " (send @ time " << ack.send_timestamp_acked
+	 << ", received @ time " << ack.recv_timestamp_acked << " by receiver's clock"
+	 << ", " << ack.datagrams_acked << " newly acked"
+	 << ", " << next_sequence_number - ack.sequence_number_acked - 1 << " in flight)"
+	 << endl;
+  }
 }
 
-void Controller::update_bw( const double new_bw, const uint64_t seqno )
+/* Some datagrams were declared lost */
+void Controller::datagrams_lost( const LossEvent & loss,
+				 const uint64_t next_sequence_number )
+				 /* what the sender will send next */
 {
-  while (!bw_filter_.empty() && bw_filter_.front().seqno < seqno - 3) {
-    bw_filter_.pop_front();
+  if ( debug_ ) {
+    cerr << "At time " << loss.timestamp
+	 << " declared " << loss.datagrams_lost << " datagrams lost"
+	 << " (newest " << loss.largest_lost
+	 << ( loss.timeout ? ", by timeout" : "" )
+	 << ", " << loss.in_flight << " in flight"
+	 << ", next " << next_sequence_number << ")" << endl;
   }
+}
 
-  while (!bw_filter_.empty() && bw_filter_.back().bw < new_bw) {
-    bw_filter_.pop_back();
-  }
+/* every controller, by name */
+namespace {
+  typedef unique_ptr<Controller> (*ControllerFactory)( const bool, const ControllerParams & );
 
-  bw_filter_.push_back( bw_sample_( seqno, new_bw ) );
+  template <class T>
+  unique_ptr<Controller> make( const bool debug, const ControllerParams & params )
+  {
+    return unique_ptr<Controller>( new T( debug, params ) );
+  }
 
-  /*
-  cerr << "new bw = " << new_bw << ", windowed = " << get_bw()
-       << ", deque size = " << bw_filter_.size() << endl;
-       */
+  struct RegisteredController
+  {
+    const char * name;
+    ControllerFactory factory;
+  };
+
+  const RegisteredController registry[] = {
+    { "bbrish", make<BBRishController> },
+    { "aimd", make<AIMDController> },
+    { "vegas", make<VegasController> },
+    { "copa", make<CopaController> },
+    { "cubic", make<CubicController> },
+    { "bbr", make<BBRController> },
+    { "sprout", make<SproutController> },
+  };
 }
 
-uint64_t Controller::get_rtt( void )
+unique_ptr<Controller> make_controller( const string & name,
+					const bool debug,
+					const ControllerParams & params )
 {
-  tp now = std::chrono::system_clock::now();
-  while (!rtt_filter_.empty() && now - rtt_filter_.front().time > std::chrono::seconds(3)) {
-    rtt_filter_.pop_front();
-  }
+  for ( const auto & entry : registry ) {
+    if ( name != entry.name ) {
+      continue;
+    }
+
+    unique_ptr<Controller> ret = entry.factory( debug, params );
+
+    const auto unused = params.unused();
+    if ( not unused.empty() ) {
+      throw runtime_error( "controller " + name + " has no parameter " + unused.front() );
+    }
 
-  if (state_ == NORMAL && rtt_filter_.empty()) {
-    cerr << "Entering ProbeRTT" << endl;
-    state_ = PROBE_RTT;
-    probe_rtt_start_ = now;
+    return ret;
   }
 
-  return rtt_filter_.empty() ? 100 : rtt_filter_.front().rtt;
+  string known;
+  for ( const auto & entry : registry ) {
+    known += string( known.empty() ? "" : ", " ) + entry.name;
+  }
+  throw runtime_error( "unknown controller " + name + " (known: " + known + ")" );
 }
 
-void Controller::update_rtt( const uint64_t new_rtt )
+vector<string> controller_names( void )
 {
-  tp now = std::chrono::system_clock::now();
-  while (!rtt_filter_.empty() && rtt_filter_.back().rtt > new_rtt) {
-    rtt_filter_.pop_back();
+  vector<string> ret;
+  for ( const auto & entry : registry ) {
+    ret.push_back( entry.name );
   }
-
-  /*
-  cerr << "new rtt = " << new_rtt << ", windowed = " << get_rtt()
-       << ", deque size = " << rtt_filter_.size() << endl;
-       */
-
-  rtt_filter_.push_back(rtt_sample_( now, new_rtt ));
+  return ret;
 }
@@ -2,85 +2,146 @@
 #define CONTROLLER_HH
 
 #include <cstdint>
-#include <deque>
-#include <unordered_map>
-#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
-/* Congestion controller interface */
+/* Algorithm-specific settings for a congestion controller (name=value) */
 
-class Controller
+class ControllerParams
 {
-  typedef std::chrono::time_point<std::chrono::system_clock> tp;
-
 private:
-  bool debug_; /* Enables debugging output */
+  std::map<std::string, std::string> values_;
+  mutable std::set<std::string> used_;
 
-  /* Add member variables here */
-  struct bw_sample_ {
-    uint64_t seqno;
-    double bw;
+public:
+  ControllerParams() : values_(), used_() {}
 
-    bw_sample_( uint64_t seqno_, double bw_ ) : seqno( seqno_ ), bw( bw_ ) { }
-  };
-  std::deque<bw_sample_> bw_filter_;
+  /* set a parameter, from its name and value or from "name=value" */
+  void set( const std::string & name, const std::string & value );
+  void set( const std::string & assignment );
 
-  struct rtt_sample_ {
-    tp time;
-    uint64_t rtt;
+  /* value of a numeric parameter, or default_value if it wasn't set */
+  double get( const std::string & name, const double default_value ) const;
 
-    rtt_sample_( tp time_, uint64_t rtt_ ) : time( time_ ), rtt( rtt_ ) { }
-  };
-  std::deque<rtt_sample_> rtt_filter_;
+  /* parameters that were set but never asked for (probably typos) */
+  std::vector<std::string> unused( void ) const;
 
-  uint64_t delivered_;  // # packets.
+  /* "name=value,name=value" */
+  std::string to_string( void ) const;
+};
 
-  struct packet_ {
-    uint64_t delivered;
-  };
-  std::unordered_map<uint64_t, packet_> packets_;  // seqno =>.
+/* What the sender learned from one ack (which may cover several datagrams) */
 
-  double get_bw( void );
-  void update_bw( const double new_bw, const uint64_t seqno );
+struct AckEvent
+{
+  uint64_t sequence_number_acked;  /* the newest datagram the ack covers */
+  uint64_t send_timestamp_acked;   /* when it was sent (sender's clock) */
+  uint64_t recv_timestamp_acked;   /* when it was received (receiver's clock) */
+  uint64_t timestamp_ack_received; /* when the ack arrived (sender's clock) */
 
-  uint64_t get_rtt( void );
-  void update_rtt( const uint64_t new_rtt );
+  uint64_t cumulative_ack;         /* every datagram before this has been acked */
+  uint64_t datagrams_acked;        /* how many datagrams this ack newly covers */
+};
 
-  uint64_t sequence_number_;
+/* Datagrams the sender has given up on */
 
-  enum {
-    NORMAL,
-    PROBE_RTT,
-  } state_;
+struct LossEvent
+{
+  uint64_t timestamp;              /* when the loss was detected (sender's clock) */
+  uint64_t largest_lost;           /* the newest datagram declared lost */
+  uint64_t datagrams_lost;
+  uint64_t in_flight;              /* datagrams still in flight afterwards */
+  bool timeout;                    /* declared by a retransmission timeout */
+};
+
+/* Phases a controller may announce (recorded by the flight recorder) */
+
+enum class ControllerState : uint32_t {
+  Normal,
+  SlowStart,
+  CongestionAvoidance,
+  Recovery,
+  Startup,
+  Drain,
+  ProbeBW,
+  ProbeRTT,
+  COUNT
+};
 
-  tp probe_rtt_start_;
+/* "ProbeRTT", etc. */
+const char * state_name( const ControllerState state );
+
+/* Congestion controller interface */
+
+class Controller
+{
+public:
+  /* a source of the current time, in microseconds */
+  typedef std::function<uint64_t( void )> Clock;
+
+private:
+  Clock clock_;
+  uint16_t flow_; /* which of the sender's flows this is, for the flight recorder */
+
+protected:
+  bool debug_; /* Enables debugging output */
+
+  /* announce a change of phase */
+  void record_state( const ControllerState state );
+
+  /* what time it is now (use this rather than calling timestamp_us() directly,
+     so the controller also runs against a simulated clock) */
+  uint64_t now_us( void ) const { return clock_(); }
 
 public:
   /* Public interface for the congestion controller */
   /* You can change these if you prefer, but will need to change
      the call site as well (in sender.cc) */
 
-  /* Default constructor */
   Controller( const bool debug );
+  virtual ~Controller() {}
+
+  /* replace the real clock (timestamp_us) */
+  void set_clock( const Clock & clock ) { clock_ = clock; }
+
+  virtual void set_flow( const uint16_t flow ) { flow_ = flow; }
 
   /* Get current window size, in datagrams */
-  unsigned int window_size( void );
+  virtual unsigned int window_size( void ) = 0;
 
-  /* A datagram was sent */
-  void datagram_was_sent( const uint64_t sequence_number,
-			  const uint64_t send_timestamp );
+  /* A datagram was sent (timestamps here are in microseconds) */
+  virtual void datagram_was_sent( const uint64_t sequence_number,
+				  const uint64_t send_timestamp,
+				  const uint64_t size );
 
   /* An ack was received */
-  void ack_received( const uint64_t sequence_number_acked,
-		     const uint64_t send_timestamp_acked,
-		     const uint64_t recv_timestamp_acked,
-		     const uint64_t timestamp_ack_received,
-         const uint64_t sequence_number );
+  virtual void ack_received( const AckEvent & ack,
+			     const uint64_t next_sequence_number );
+
+  /* Some datagrams were declared lost */
+  virtual void datagrams_lost( const LossEvent & loss,
+			       const uint64_t next_sequence_number );
 
   /* How long to wait (in milliseconds) if there are no acks
      before sending one more datagram */
-  unsigned int timeout_ms( void );
+  virtual unsigned int timeout_ms( void ) { return 200; }
 
-  void increment_sequence_number( void ) { sequence_number_++; }
+  /* How fast to release datagrams (in datagrams per millisecond)
+     when the sender paces its transmissions */
+  virtual double pacing_rate( void ) = 0;
 };
 
+/* Make the congestion controller with the given name
+   (throws if there is no such controller or it doesn't use one of the params) */
+std::unique_ptr<Controller> make_controller( const std::string & name,
+					     const bool debug,
+					     const ControllerParams & params );
+
+/* Names of every congestion controller make_controller() knows */
+std::vector<std::string> controller_names( void );
+
 #endif
@@ -0,0 +1,119 @@
+#include <algorithm>
+
+#include "copa_controller.hh"
+
+using namespace std;
+
+/* RTT to assume before the first sample, in microseconds */
+static const uint64_t INITIAL_RTT = 100 * 1000;
+
+/* rounds in the same direction before the velocity starts doubling */
+static const unsigned int VELOCITY_ROUNDS = 3;
+
+CopaController::CopaController( const bool debug, const ControllerParams & params )
+  : Controller( debug ),
+    delta_( params.get( "delta", .5 ) ),
+    min_window_( params.get( "min_window", 2 ) ),
+    rtt_(),
+    window_( params.get( "initial_window", 10 ) ),
+    slow_start_( true ),
+    recent_delays_(),
+    has_delay_( false ),
+    min_delay_( 0 ),
+    standing_rtt_( INITIAL_RTT ),
+    velocity_( 1 ),
+    direction_( 0 ),
+    same_direction_rounds_( 0 ),
+    round_start_window_( window_ ),
+    round_end_( 0 )
+{}
+
+unsigned int CopaController::window_size( void )
+{
+  return window_;
+}
+
+/* add a sample and return the min one-way delay over the last half smoothed RTT */
+int64_t CopaController::standing_delay( const uint64_t now, const int64_t delay )
+{
+  while ( not recent_delays_.empty() and recent_delays_.back().delay >= delay ) {
+    recent_delays_.pop_back();
+  }
+  recent_delays_.push_back( { now, delay } );
+
+  const uint64_t horizon = rtt_.smoothed( INITIAL_RTT ) / 2;
+  while ( recent_delays_.size() > 1 and now - recent_delays_.front().time > horizon ) {
+    recent_delays_.pop_front();
+  }
+
+  return recent_delays_.front().delay;
+}
+
+/* speed up while the window keeps moving the same way */
+void CopaController::end_round( const uint64_t next_sequence_number )
+{
+  const int direction = window_ >= round_start_window_ ? 1 : -1;
+
+  if ( direction == direction_ ) {
+    same_direction_rounds_++;
+    if ( same_direction_rounds_ >= VELOCITY_ROUNDS ) {
+      /* but never faster than doubling (or halving) the window in a round */
+      velocity_ = min( velocity_ * 2, max( 1.0, delta_ * window_ ) );
+    }
+  } else {
+    same_direction_rounds_ = 0;
+    velocity_ = 1;
+  }
+
+  direction_ = direction;
+  round_start_window_ = window_;
+  round_end_ = next_sequence_number;
+}
+
+void CopaController::ack_received( const AckEvent & ack,
+				   const uint64_t next_sequence_number )
+{
+  const uint64_t rtt = max<uint64_t>( ack.timestamp_ack_received - ack.send_timestamp_acked, 1 );
+  rtt_.update( rtt );
+
+  const int64_t delay = int64_t( ack.recv_timestamp_acked ) - int64_t( ack.send_timestamp_acked );
+  min_delay_ = has_delay_ ? min( min_delay_, delay ) : delay;
+  has_delay_ = true;
+
+  const uint64_t queueing_delay = standing_delay( ack.timestamp_ack_received, delay ) - min_delay_;
+  standing_rtt_ = rtt_.min( INITIAL_RTT ) + queueing_delay;
+
+  /* compare rates in datagrams per microsecond (no queue means any rate is fine) */
+  const bool increase = queueing_delay == 0
+    or window_ / standing_rtt_ <= 1 / (delta_ * queueing_delay);
+
+  /* Each datagram acked moves the window by velocity / (delta x window),
+     measured against the window at the start of the round, so the window
+     moves by velocity / delta a round however the acks are bunched up.
+     Capping the move at that (at most doubling in slow start) keeps
+     stretched acks and a window that shrank within the round from
+     moving it further. */
+  if ( slow_start_ and increase ) {
+    window_ = min( window_ + ack.datagrams_acked, 2 * round_start_window_ );
+  } else {
+    slow_start_ = false;
+    const double most = velocity_ / delta_;
+    const double step = ack.datagrams_acked * velocity_ / (delta_ * round_start_window_);
+    window_ = increase
+      ? min( window_ + step, round_start_window_ + most )
+      : max( window_ - step, round_start_window_ - most );
+    window_ = max( window_, min_window_ );
+  }
+
+  if ( ack.sequence_number_acked >= round_end_ ) {
+    end_round( next_sequence_number );
+  }
+
+  Controller::ack_received( ack, next_sequence_number );
+}
+
+/* Copa paces at twice the window per standing RTT */
+double CopaController::pacing_rate( void )
+{
+  return 2 * window_ / (standing_rtt_ / 1000.0);
+}
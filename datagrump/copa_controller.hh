@@ -0,0 +1,61 @@
+#ifndef COPA_CONTROLLER_HH
+#define COPA_CONTROLLER_HH
+
+#include <cstdint>
+#include <deque>
+
+#include "controller.hh"
+#include "rtt_estimator.hh"
+
+/* Copa (Arun and Balakrishnan, NSDI 2018): steer the sending rate
+   toward 1 / (delta x queueing delay), where the queueing delay is
+   the "standing" delay (min over the last half RTT) minus the min.
+   The step size doubles while the window keeps moving the same way.
+
+   The delays are one-way (the receiver's clock minus the sender's, so
+   their difference cancels when one is subtracted from another): a
+   delayed ack would otherwise look like a queue. */
+
+class CopaController : public Controller
+{
+private:
+  /* Tunable parameters */
+  double delta_;
+  double min_window_;   /* datagrams */
+
+  RTTEstimator rtt_;
+  double window_;       /* datagrams */
+  bool slow_start_;
+
+  /* recent one-way delays, increasing, to find the standing delay */
+  struct delay_sample_ {
+    uint64_t time;  /* us */
+    int64_t delay;  /* us (plus the clocks' offset) */
+  };
+  std::deque<delay_sample_> recent_delays_;
+  bool has_delay_;
+  int64_t min_delay_;           /* us (plus the clocks' offset) */
+  uint64_t standing_rtt_;       /* us: min RTT plus the queueing delay */
+
+  /* velocity, updated once per round */
+  double velocity_;
+  int direction_;             /* +1, -1, or 0 before the first round */
+  unsigned int same_direction_rounds_;
+  double round_start_window_;
+  uint64_t round_end_;        /* the round ends when this datagram is acked */
+
+  int64_t standing_delay( const uint64_t now, const int64_t delay );
+  void end_round( const uint64_t next_sequence_number );
+
+public:
+  CopaController( const bool debug, const ControllerParams & params );
+
+  unsigned int window_size( void ) override;
+
+  void ack_received( const AckEvent & ack,
+		     const uint64_t next_sequence_number ) override;
+
+  double pacing_rate( void ) override;
+};
+
+#endif
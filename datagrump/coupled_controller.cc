@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cmath>
+
+#include "coupled_controller.hh"
+
+using namespace std;
+
+/* most of a member's datagrams that can be in flight at once
+   before the oldest are forgotten */
+static const size_t MEMBER_CAPACITY = 16384;
+
+SharedBottleneck::Member::Member( const double s_weight, const size_t capacity )
+  : weight( s_weight ),
+    active( false ),
+    in_flight( 0 ),
+    cumulative_ack( 0 ),
+    shared_seqno( capacity )
+{}
+
+SharedBottleneck::SharedBottleneck( unique_ptr<Controller> && controller )
+  : controller_( move( controller ) ),
+    next_sequence_number_( 0 ),
+    members_(),
+    active_weight_( 0 )
+{}
+
+size_t SharedBottleneck::join( const double weight )
+{
+  members_.emplace_back( weight, MEMBER_CAPACITY );
+  return members_.size() - 1;
+}
+
+void SharedBottleneck::set_flow( const size_t member, const uint16_t flow )
+{
+  if ( member == 0 ) {
+    controller_->set_flow( flow );
+  }
+}
+
+/* every member's datagrams in flight */
+uint64_t SharedBottleneck::in_flight( void ) const
+{
+  uint64_t ret = 0;
+  for ( const auto & member : members_ ) {
+    ret += member.in_flight;
+  }
+  return ret;
+}
+
+/* every shared sequence number before this has been acked (or given up on)
+   by the member that sent it */
+uint64_t SharedBottleneck::cumulative_ack( void ) const
+{
+  uint64_t ret = next_sequence_number_;
+  for ( const auto & member : members_ ) {
+    if ( member.active ) {
+      ret = min( ret, member.cumulative_ack );
+    }
+  }
+  return ret;
+}
+
+unsigned int SharedBottleneck::window_size( const size_t member )
+{
+  const Member & m = members_.at( member );
+  const double total_weight = active_weight_ + (m.active ? 0 : m.weight);
+
+  return ceil( controller_->window_size() * m.weight / total_weight );
+}
+
+double SharedBottleneck::pacing_rate( const size_t member )
+{
+  const Member & m = members_.at( member );
+  const double total_weight = active_weight_ + (m.active ? 0 : m.weight);
+
+  return controller_->pacing_rate() * m.weight / total_weight;
+}
+
+void SharedBottleneck::datagram_was_sent( const size_t member,
+					  const uint64_t sequence_number,
+					  const uint64_t send_timestamp,
+					  const uint64_t size )
+{
+  Member & m = members_.at( member );
+
+  if ( not m.active ) {
+    m.active = true;
+    m.cumulative_ack = next_sequence_number_;
+    active_weight_ += m.weight;
+  }
+
+  /* a retransmission is a new datagram to the shared controller */
+  const uint64_t shared = next_sequence_number_++;
+  m.shared_seqno.insert( sequence_number ) = shared;
+  m.in_flight++;
+
+  controller_->datagram_was_sent( shared, send_timestamp, size );
+}
+
+void SharedBottleneck::ack_received( const size_t member, const AckEvent & ack,
+				     const uint64_t next_sequence_number )
+{
+  Member & m = members_.at( member );
+
+  m.in_flight -= min( m.in_flight, ack.datagrams_acked );
+
+  if ( ack.cumulative_ack >= next_sequence_number ) {
+    m.cumulative_ack = next_sequence_number_; /* nothing outstanding */
+  } else {
+    const uint64_t * oldest = m.shared_seqno.find( ack.cumulative_ack );
+    if ( oldest ) {
+      m.cumulative_ack = max( m.cumulative_ack, *oldest );
+    }
+  }
+
+  /* an ack for a datagram the ring has forgotten is as if it never came */
+  const uint64_t * shared = m.shared_seqno.find( ack.sequence_number_acked );
+  if ( not shared ) {
+    return;
+  }
+
+  AckEvent shared_ack = ack;
+  shared_ack.sequence_number_acked = *shared;
+  shared_ack.cumulative_ack = cumulative_ack();
+
+  controller_->ack_received( shared_ack, next_sequence_number_ );
+}
+
+void SharedBottleneck::datagrams_lost( const size_t member, const LossEvent & loss,
+				       const uint64_t )
+{
+  Member & m = members_.at( member );
+
+  /* the member's count is authoritative */
+  m.in_flight = loss.in_flight;
+
+  const uint64_t * shared = m.shared_seqno.find( loss.largest_lost );
+
+  LossEvent shared_loss = loss;
+  shared_loss.largest_lost = shared ? *shared : cumulative_ack();
+  shared_loss.in_flight = in_flight();
+
+  controller_->datagrams_lost( shared_loss, next_sequence_number_ );
+}
+
+unsigned int SharedBottleneck::timeout_ms( void )
+{
+  return controller_->timeout_ms();
+}
+
+CoupledController::CoupledController( const shared_ptr<SharedBottleneck> & bottleneck,
+				      const double weight )
+  : Controller( false ), bottleneck_( bottleneck ), member_( bottleneck->join( weight ) )
+{}
+
+void CoupledController::set_flow( const uint16_t flow )
+{
+  Controller::set_flow( flow );
+  bottleneck_->set_flow( member_, flow );
+}
+
+unsigned int CoupledController::window_size( void )
+{
+  return bottleneck_->window_size( member_ );
+}
+
+void CoupledController::datagram_was_sent( const uint64_t sequence_number,
+					   const uint64_t send_timestamp,
+					   const uint64_t size )
+{
+  bottleneck_->datagram_was_sent( member_, sequence_number, send_timestamp, size );
+}
+
+void CoupledController::ack_received( const AckEvent & ack,
+				      const uint64_t next_sequence_number )
+{
+  bottleneck_->ack_received( member_, ack, next_sequence_number );
+}
+
+void CoupledController::datagrams_lost( const LossEvent & loss,
+					const uint64_t next_sequence_number )
+{
+  bottleneck_->datagrams_lost( member_, loss, next_sequence_number );
+}
+
+unsigned int CoupledController::timeout_ms( void )
+{
+  return bottleneck_->timeout_ms();
+}
+
+double CoupledController::pacing_rate( void )
+{
+  return bottleneck_->pacing_rate( member_ );
+}
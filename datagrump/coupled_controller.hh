@@ -0,0 +1,102 @@
+#ifndef COUPLED_CONTROLLER_HH
+#define COUPLED_CONTROLLER_HH
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include "controller.hh"
+#include "sequence_ring.hh"
+
+/* Congestion control shared by flows that cross the same bottleneck
+   (in the spirit of the Congestion Manager, RFC 3124, and of RFC 8699's
+   flow state exchange). One controller sees every member's datagrams,
+   renumbered into a single sequence-number space, so the path's
+   bandwidth and min RTT are estimated (and probed for) once, not once
+   per flow. Each member gets a share of the aggregate window and pacing
+   rate in proportion to its weight.
+
+   Members must share one thread (and event loop): a member's window
+   can shrink whenever another member hears an ack. */
+
+class SharedBottleneck
+{
+private:
+  struct Member
+  {
+    double weight;
+    bool active;                          /* has sent a datagram */
+    uint64_t in_flight;                   /* as far as the member has told us */
+    uint64_t cumulative_ack;              /* in the shared sequence-number space */
+    SequenceRing<uint64_t> shared_seqno;  /* member's sequence number -> shared one */
+
+    Member( const double s_weight, const size_t capacity );
+  };
+
+  std::unique_ptr<Controller> controller_;
+  uint64_t next_sequence_number_; /* shared */
+  std::deque<Member> members_;
+  double active_weight_;
+
+  uint64_t in_flight( void ) const;
+  uint64_t cumulative_ack( void ) const;
+
+public:
+  SharedBottleneck( std::unique_ptr<Controller> && controller );
+
+  /* add a member with the given weight, returning its index */
+  size_t join( const double weight );
+
+  /* the shared controller's flight records carry its first member's flow */
+  void set_flow( const size_t member, const uint16_t flow );
+
+  /* the member's share of the aggregate window (rounded up, so it
+     never starves) and of the pacing rate; a member that hasn't sent
+     yet is counted as if it had */
+  unsigned int window_size( const size_t member );
+  double pacing_rate( const size_t member );
+
+  /* events from a member, with its own sequence numbers */
+  void datagram_was_sent( const size_t member, const uint64_t sequence_number,
+			  const uint64_t send_timestamp, const uint64_t size );
+  void ack_received( const size_t member, const AckEvent & ack,
+		     const uint64_t next_sequence_number );
+  void datagrams_lost( const size_t member, const LossEvent & loss,
+		       const uint64_t next_sequence_number );
+
+  unsigned int timeout_ms( void );
+};
+
+/* One member's view of a SharedBottleneck, for a sender that expects
+   a Controller of its own */
+
+class CoupledController : public Controller
+{
+private:
+  std::shared_ptr<SharedBottleneck> bottleneck_;
+  size_t member_;
+
+public:
+  CoupledController( const std::shared_ptr<SharedBottleneck> & bottleneck,
+		     const double weight );
+
+  void set_flow( const uint16_t flow ) override;
+
+  unsigned int window_size( void ) override;
+
+  void datagram_was_sent( const uint64_t sequence_number,
+			  const uint64_t send_timestamp,
+			  const uint64_t size ) override;
+
+  void ack_received( const AckEvent & ack,
+		     const uint64_t next_sequence_number ) override;
+
+  void datagrams_lost( const LossEvent & loss,
+		       const uint64_t next_sequence_number ) override;
+
+  unsigned int timeout_ms( void ) override;
+
+  double pacing_rate( void ) override;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cubic_controller.hh"
+
+using namespace std;
+
+/* RTT to assume before the first sample, in microseconds */
+static const uint64_t INITIAL_RTT = 100 * 1000;
+
+CubicController::CubicController( const bool debug, const ControllerParams & params )
+  : Controller( debug ),
+    c_( params.get( "c", .4 ) ),
+    beta_( params.get( "beta", .7 ) ),
+    delay_threshold_( params.get( "delay_threshold_ms", 50 ) * 1000 ),
+    min_window_( params.get( "min_window", 2 ) ),
+    rtt_(),
+    window_( params.get( "initial_window", 10 ) ),
+    slow_start_threshold_( numeric_limits<double>::max() ),
+    window_max_( 0 ),
+    k_( 0 ),
+    epoch_start_( 0 ),
+    reno_window_( 0 ),
+    recovery_end_( 0 )
+{}
+
+unsigned int CubicController::window_size( void )
+{
+  return window_;
+}
+
+/* multiplicative decrease, and start a new epoch on the next ack */
+void CubicController::congestion_event( const uint64_t next_sequence_number )
+{
+  window_max_ = window_;
+  window_ = max( window_ * beta_, min_window_ );
+  slow_start_threshold_ = window_;
+  epoch_start_ = 0;
+  recovery_end_ = next_sequence_number;
+}
+
+/* congestion avoidance (RFC 8312 section 4), for an ack covering `acked` datagrams */
+void CubicController::grow( const uint64_t now, const uint64_t acked )
+{
+  if ( epoch_start_ == 0 ) {
+    epoch_start_ = now;
+    window_max_ = max( window_max_, window_ );
+    k_ = cbrt( window_max_ * (1 - beta_) / c_ );
+    reno_window_ = window_;
+  }
+
+  const double rtt = rtt_.smoothed( INITIAL_RTT ) / 1e6;
+  const double t = (now - epoch_start_) / 1e6 + rtt;
+  const double cubic_target = c_ * pow( t - k_, 3 ) + window_max_;
+
+  /* what Reno would have by now, with the same average decrease */
+  reno_window_ += acked * 3 * (1 - beta_) / (1 + beta_) / window_;
+
+  if ( reno_window_ > cubic_target ) {
+    window_ = max( window_, reno_window_ );
+  } else if ( cubic_target > window_ ) {
+    window_ += min<double>( acked * (cubic_target - window_) / window_,
+			   cubic_target - window_ );
+  } else {
+    window_ += acked * .01 / window_;
+  }
+}
+
+void CubicController::ack_received( const AckEvent & ack,
+				    const uint64_t next_sequence_number )
+{
+  const uint64_t rtt = max<uint64_t>( ack.timestamp_ack_received - ack.send_timestamp_acked, 1 );
+  rtt_.update( rtt );
+
+  const bool congested = rtt > rtt_.min( INITIAL_RTT ) + delay_threshold_;
+
+  if ( congested and ack.sequence_number_acked >= recovery_end_ ) {
+    congestion_event( next_sequence_number );
+  } else if ( not congested ) {
+    if ( window_ < slow_start_threshold_ ) {
+      window_ += ack.datagrams_acked;
+    } else {
+      grow( ack.timestamp_ack_received, ack.datagrams_acked );
+    }
+  }
+
+  Controller::ack_received( ack, next_sequence_number );
+}
+
+void CubicController::datagrams_lost( const LossEvent & loss,
+				      const uint64_t next_sequence_number )
+{
+  if ( loss.timeout ) {
+    congestion_event( next_sequence_number );
+    window_ = min_window_;
+  } else if ( loss.largest_lost >= recovery_end_ ) {
+    congestion_event( next_sequence_number );
+  }
+
+  Controller::datagrams_lost( loss, next_sequence_number );
+}
+
+/* one window per smoothed RTT */
+double CubicController::pacing_rate( void )
+{
+  return window_ / (rtt_.smoothed( INITIAL_RTT ) / 1000.0);
+}
@@ -0,0 +1,54 @@
+#ifndef CUBIC_CONTROLLER_HH
+#define CUBIC_CONTROLLER_HH
+
+#include <cstdint>
+
+#include "controller.hh"
+#include "rtt_estimator.hh"
+
+/* CUBIC (RFC 8312): after a congestion event the window follows
+   C (t - K)^3 + W_max, flattening out around the window where the
+   last event happened, and never grows slower than Reno would.
+   As with AIMD, congestion is a loss or the RTT rising delay_threshold_ms
+   above the minimum, at most once per window. */
+
+class CubicController : public Controller
+{
+private:
+  /* Tunable parameters */
+  double c_;                      /* datagrams / s^3 */
+  double beta_;
+  uint64_t delay_threshold_;      /* us */
+  double min_window_;             /* datagrams */
+
+  RTTEstimator rtt_;
+  double window_;                 /* datagrams */
+  double slow_start_threshold_;   /* datagrams */
+
+  /* state of the current congestion-avoidance epoch */
+  double window_max_;             /* datagrams */
+  double k_;                      /* s */
+  uint64_t epoch_start_;          /* us, 0 if not in an epoch */
+  double reno_window_;            /* datagrams */
+
+  /* no more decreases until this datagram is acked */
+  uint64_t recovery_end_;
+
+  void congestion_event( const uint64_t next_sequence_number );
+  void grow( const uint64_t now, const uint64_t acked );
+
+public:
+  CubicController( const bool debug, const ControllerParams & params );
+
+  unsigned int window_size( void ) override;
+
+  void ack_received( const AckEvent & ack,
+		     const uint64_t next_sequence_number ) override;
+
+  void datagrams_lost( const LossEvent & loss,
+		       const uint64_t next_sequence_number ) override;
+
+  double pacing_rate( void ) override;
+};
+
+#endif
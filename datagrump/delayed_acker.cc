@@ -0,0 +1,87 @@
+#include <iterator>
+
+#include "delayed_acker.hh"
+
+using namespace std;
+
+DelayedAcker::DelayedAcker( const unsigned int ack_every, const uint64_t delay_us )
+  : ack_every_( ack_every ),
+    delay_us_( delay_us ),
+    cumulative_ack_( 0 ),
+    ranges_(),
+    unacked_( 0 ),
+    latest_( 0 )
+{}
+
+bool DelayedAcker::received( const uint64_t sequence_number )
+{
+  unacked_++;
+  latest_ = sequence_number;
+
+  if ( sequence_number < cumulative_ack_ ) {
+    return true; /* a duplicate: maybe our last ack was lost */
+  }
+
+  /* the range that starts after this datagram, and the one before it */
+  auto next = ranges_.upper_bound( sequence_number );
+  auto previous = next == ranges_.begin() ? ranges_.end() : prev( next );
+
+  if ( previous != ranges_.end() and sequence_number < previous->second ) {
+    return true; /* a duplicate */
+  }
+
+  /* in order if it extends the newest run (an old hole that is never
+     filled shouldn't make every ack after it immediate) */
+  const uint64_t expected = ranges_.empty() ? cumulative_ack_ : ranges_.rbegin()->second;
+  const bool in_order = sequence_number == expected;
+
+  /* add it, merging with the ranges on either side */
+  uint64_t first = sequence_number, last = sequence_number + 1;
+  if ( previous != ranges_.end() and previous->second == sequence_number ) {
+    first = previous->first;
+    ranges_.erase( previous );
+  }
+  if ( next != ranges_.end() and next->first == last ) {
+    last = next->second;
+    ranges_.erase( next );
+  }
+
+  if ( first == cumulative_ack_ ) {
+    cumulative_ack_ = last;
+  } else {
+    ranges_.emplace( first, last );
+    if ( ranges_.size() > MAX_TRACKED_RANGES ) {
+      /* the oldest hole is probably never going to be filled: stop waiting for it */
+      cumulative_ack_ = ranges_.begin()->second;
+      ranges_.erase( ranges_.begin() );
+    }
+  }
+
+  /* anything that opens or fills a hole is worth telling the sender about now */
+  return not in_order or unacked_ >= ack_every_;
+}
+
+ContestMessage::AckBlock DelayedAcker::take_ack_block( void )
+{
+  ContestMessage::AckBlock block( cumulative_ack_, unacked_ );
+
+  /* the range holding the latest arrival (if it is above the cumulative ack) */
+  auto latest = ranges_.upper_bound( latest_ );
+  if ( latest != ranges_.begin() and latest_ < prev( latest )->second ) {
+    latest = prev( latest );
+    block.ranges.emplace_back( latest->first, latest->second );
+  } else {
+    latest = ranges_.end();
+  }
+
+  for ( auto range = ranges_.rbegin();
+	range != ranges_.rend() and block.ranges.size() < ContestMessage::AckBlock::MAX_RANGES;
+	range++ ) {
+    if ( latest == ranges_.end() or range->first != latest->first ) {
+      block.ranges.emplace_back( range->first, range->second );
+    }
+  }
+
+  unacked_ = 0;
+  return block;
+}
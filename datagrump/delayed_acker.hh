@@ -0,0 +1,46 @@
+#ifndef DELAYED_ACKER_HH
+#define DELAYED_ACKER_HH
+
+#include <cstdint>
+#include <map>
+
+#include "contest_message.hh"
+
+/* The receiver's side of cumulative acks for one sender: remembers
+   which datagrams have arrived and decides when to ack them
+   (every Nth datagram, right away when one opens or fills a hole,
+   or else once the oldest unacked one has waited delay_us) */
+
+class DelayedAcker
+{
+private:
+  unsigned int ack_every_;
+  uint64_t delay_us_;
+
+  uint64_t cumulative_ack_; /* next datagram expected in order */
+  std::map<uint64_t, uint64_t> ranges_; /* received above cumulative_ack_: first => last + 1 */
+  uint64_t unacked_; /* datagrams received since the last ack */
+  uint64_t latest_;  /* the datagram that arrived most recently */
+
+public:
+  /* most ranges remembered (if there are more, the cumulative ack
+     skips over the oldest hole, which the sender has likely given up on) */
+  static const size_t MAX_TRACKED_RANGES = 1024;
+
+  DelayedAcker( const unsigned int ack_every, const uint64_t delay_us );
+
+  /* a datagram arrived: returns true if it should be acked now */
+  bool received( const uint64_t sequence_number );
+
+  /* how long the first unacked datagram may wait for its ack */
+  uint64_t delay_us( void ) const { return delay_us_; }
+  bool ack_pending( void ) const { return unacked_ > 0; }
+
+  /* describe everything received so far (the range holding the latest
+     arrival first, as in RFC 2018, so a retransmission that fills an old
+     hole is reported even when there are more ranges than fit), and
+     start counting again */
+  ContestMessage::AckBlock take_ack_block( void );
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include <algorithm>
+
+#include "delivery_rate.hh"
+
+using namespace std;
+
+DeliveryRateEstimator::DeliveryRateEstimator( const size_t capacity )
+  : sent_( capacity ),
+    delivered_( 0 ),
+    delivered_datagrams_( 0 ),
+    delivered_time_( 0 ),
+    first_sent_time_( 0 ),
+    in_flight_( 0 ),
+    in_flight_bytes_( 0 ),
+    app_limited_until_( 0 ),
+    round_count_( 0 ),
+    next_round_delivered_( 0 )
+{}
+
+void DeliveryRateEstimator::sent( const uint64_t sequence_number,
+				  const uint64_t send_timestamp,
+				  const uint64_t size )
+{
+  /* after an idle spell, start both intervals afresh */
+  if ( in_flight_ == 0 ) {
+    first_sent_time_ = delivered_time_ = send_timestamp;
+  }
+
+  sent_.insert( sequence_number ) = { delivered_, delivered_datagrams_, delivered_time_,
+				      first_sent_time_, send_timestamp, size,
+				      app_limited_until_ != 0 };
+  in_flight_++;
+  in_flight_bytes_ += size;
+}
+
+RateSample DeliveryRateEstimator::acked( const AckEvent & ack, const uint64_t min_rtt )
+{
+  RateSample sample { false, 0, 0, 0, false, false };
+
+  const Sent * datagram = sent_.find( ack.sequence_number_acked );
+  const uint64_t size = datagram ? datagram->size : 0;
+
+  const uint64_t acked = min( ack.datagrams_acked, in_flight_ );
+  in_flight_ -= acked;
+  in_flight_bytes_ -= min( acked * size, in_flight_bytes_ );
+
+  if ( ack.datagrams_acked == 0 or not datagram ) {
+    return sample;
+  }
+
+  delivered_ += ack.datagrams_acked * size;
+  delivered_datagrams_ += ack.datagrams_acked;
+  delivered_time_ = ack.timestamp_ack_received;
+
+  if ( app_limited_until_ and delivered_ > app_limited_until_ ) {
+    app_limited_until_ = 0;
+  }
+
+  if ( datagram->delivered >= next_round_delivered_ ) {
+    next_round_delivered_ = delivered_;
+    round_count_++;
+    sample.round_start = true;
+  }
+
+  /* the next send interval starts where this datagram's ended */
+  first_sent_time_ = datagram->sent_time;
+
+  const uint64_t send_elapsed = datagram->sent_time - datagram->first_sent_time;
+  const uint64_t ack_elapsed = delivered_time_ - datagram->delivered_time;
+
+  sample.delivered = delivered_ - datagram->delivered;
+  sample.datagrams = delivered_datagrams_ - datagram->delivered_datagrams;
+  sample.interval = max( send_elapsed, ack_elapsed );
+  sample.app_limited = datagram->app_limited;
+  sample.valid = sample.interval > 0 and sample.interval >= min_rtt;
+
+  sent_.erase( ack.sequence_number_acked );
+
+  return sample;
+}
+
+void DeliveryRateEstimator::lost( const uint64_t datagrams )
+{
+  const uint64_t lost = min( datagrams, in_flight_ );
+  if ( in_flight_ ) {
+    in_flight_bytes_ -= in_flight_bytes_ * lost / in_flight_;
+  }
+  in_flight_ -= lost;
+}
+
+void DeliveryRateEstimator::set_app_limited( void )
+{
+  app_limited_until_ = max<uint64_t>( delivered_ + in_flight_bytes_, 1 );
+}
@@ -0,0 +1,92 @@
+#ifndef DELIVERY_RATE_HH
+#define DELIVERY_RATE_HH
+
+#include <cstdint>
+
+#include "controller.hh"
+#include "sequence_ring.hh"
+
+/* One measurement of how fast the path delivered data */
+
+struct RateSample
+{
+  bool valid;             /* false if there was nothing to measure, or too little */
+  uint64_t delivered;     /* bytes delivered over the interval */
+  uint64_t datagrams;     /* datagrams delivered over the interval */
+  uint64_t interval;      /* us */
+  bool app_limited;       /* the sender wasn't using the whole path when it sent */
+  bool round_start;       /* this ack began a new packet-timed round trip */
+
+  /* delivery rate (0 if not valid) */
+  double bytes_per_us( void ) const { return valid ? double( delivered ) / interval : 0; }
+  double datagrams_per_ms( void ) const { return valid ? 1000.0 * datagrams / interval : 0; }
+};
+
+/* Delivery-rate sampling in the style of draft-cheng-iccrg-delivery-rate-estimation
+   (all times in microseconds).
+
+   Each datagram remembers how much had been delivered when it was sent,
+   and when. The ack for it then yields the amount delivered since over
+   the longer of the send and ack intervals, so a burst of compressed
+   acks can't make the path look faster than the sender was sending.
+   Samples shorter than the min RTT are not trusted at all.
+
+   Datagrams sent while the sender held back (app-limited) are marked, as
+   are their rate samples, until what was in flight then is delivered.
+   Round trips are counted by delivery: a round ends when a datagram
+   sent after the previous round ended is acked. */
+
+class DeliveryRateEstimator
+{
+private:
+  /* snapshot taken when each datagram in flight was sent */
+  struct Sent {
+    uint64_t delivered;        /* bytes */
+    uint64_t delivered_datagrams;
+    uint64_t delivered_time;
+    uint64_t first_sent_time;  /* start of the send interval it ends */
+    uint64_t sent_time;
+    uint64_t size;
+    bool app_limited;
+  };
+
+  SequenceRing<Sent> sent_;
+
+  uint64_t delivered_;           /* bytes, ever */
+  uint64_t delivered_datagrams_;
+  uint64_t delivered_time_;      /* when delivered_ last grew */
+  uint64_t first_sent_time_;
+  uint64_t in_flight_;           /* datagrams */
+  uint64_t in_flight_bytes_;
+
+  uint64_t app_limited_until_;   /* delivered_ when app-limiting ends (0 if it isn't) */
+
+  uint64_t round_count_;
+  uint64_t next_round_delivered_;
+
+public:
+  DeliveryRateEstimator( const size_t capacity );
+
+  /* a datagram (new or retransmitted) was sent */
+  void sent( const uint64_t sequence_number, const uint64_t send_timestamp,
+	     const uint64_t size );
+
+  /* an ack arrived: sample the rate from the newest datagram it covers
+     (datagrams_acked of them, each the size of that one) */
+  RateSample acked( const AckEvent & ack, const uint64_t min_rtt );
+
+  /* some datagrams in flight were declared lost */
+  void lost( const uint64_t datagrams );
+
+  /* the sender is holding back: mark what's sent until what's in flight
+     now has been delivered */
+  void set_app_limited( void );
+
+  uint64_t delivered( void ) const { return delivered_; }
+  uint64_t delivered_datagrams( void ) const { return delivered_datagrams_; }
+  uint64_t round_count( void ) const { return round_count_; }
+  uint64_t in_flight( void ) const { return in_flight_; }
+  bool app_limited( void ) const { return app_limited_until_ != 0; }
+};
+
+#endif
@@ -0,0 +1,159 @@
+/* turns a flight recorder log (sender record=FILE) into a CSV or JSON timeline */
+
+#include <cstdlib>
+#include <iostream>
+
+#include "flight_recorder.hh"
+#include "controller.hh"
+#include "util.hh"
+
+using namespace std;
+
+enum class Format { CSV, JSON };
+
+static const char * event_name( const FlightEvent type )
+{
+  switch ( type ) {
+  case FlightEvent::Sent: return "sent";
+  case FlightEvent::Acked: return "acked";
+  case FlightEvent::Lost: return "lost";
+  case FlightEvent::Timeout: return "timeout";
+  case FlightEvent::Window: return "window";
+  case FlightEvent::State: return "state";
+  case FlightEvent::COUNT: break;
+  }
+  return "unknown";
+}
+
+static const char * timeout_name( const uint32_t timeout )
+{
+  switch ( FlightTimeout( timeout ) ) {
+  case FlightTimeout::Loss: return "loss";
+  case FlightTimeout::Probe: return "probe";
+  case FlightTimeout::RTO: return "rto";
+  case FlightTimeout::Silence: return "silence";
+  }
+  return "unknown";
+}
+
+/* a name for what count means in records where it's an enum */
+static string detail( const FlightRecord & record )
+{
+  switch ( record.type ) {
+  case FlightEvent::Sent: return record.count ? "retransmission" : "";
+  case FlightEvent::Timeout: return timeout_name( record.count );
+  case FlightEvent::State: return state_name( ControllerState( record.count ) );
+  default: return "";
+  }
+}
+
+/* one JSON object, with the fields named for the event */
+static void write_json( const FlightRecord & record )
+{
+  cout << "{\"time_us\": " << record.timestamp
+       << ", \"flow\": " << record.flow
+       << ", \"event\": \"" << event_name( record.type ) << "\"";
+
+  switch ( record.type ) {
+  case FlightEvent::Sent:
+    cout << ", \"sequence_number\": " << record.sequence_number
+	 << ", \"retransmission\": " << (record.count ? "true" : "false")
+	 << ", \"bytes\": " << record.value;
+    break;
+  case FlightEvent::Acked:
+    cout << ", \"sequence_number\": " << record.sequence_number
+	 << ", \"datagrams_acked\": " << record.count
+	 << ", \"rtt_us\": " << record.value;
+    break;
+  case FlightEvent::Lost:
+    cout << ", \"sequence_number\": " << record.sequence_number
+	 << ", \"datagrams_lost\": " << record.count
+	 << ", \"in_flight\": " << record.value;
+    break;
+  case FlightEvent::Timeout:
+    cout << ", \"timeout\": \"" << detail( record ) << "\"";
+    break;
+  case FlightEvent::Window:
+    cout << ", \"window\": " << record.count
+	 << ", \"pacing_rate\": " << record.value; /* datagrams/s */
+    break;
+  case FlightEvent::State:
+    cout << ", \"state\": \"" << detail( record ) << "\"";
+    break;
+  case FlightEvent::COUNT:
+    break;
+  }
+
+  cout << "}";
+}
+
+int main( int argc, char *argv[] )
+{
+   /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  Format format = Format::CSV;
+  int flow = -1; /* all of them */
+  bool usage_error = argc < 2;
+
+  for ( int i = 2; i < argc; i++ ) {
+    const string option = argv[ i ];
+    if ( option == "format=csv" ) {
+      format = Format::CSV;
+    } else if ( option == "format=json" ) {
+      format = Format::JSON;
+    } else if ( option.compare( 0, 5, "flow=" ) == 0 ) {
+      try {
+	flow = stoul( option.substr( 5 ) );
+      } catch ( const logic_error & ) { /* stoul failed */
+	usage_error = true;
+      }
+    } else {
+      usage_error = true;
+    }
+  }
+
+  if ( usage_error ) {
+    cerr << "Usage: " << argv[ 0 ] << " LOG [format=csv|json] [flow=N]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const vector<FlightRecord> records = read_flight_log( argv[ 1 ] );
+
+    if ( format == Format::CSV ) {
+      /* count and value mean different things for each event (see flight_recorder.hh) */
+      cout << "time_us,flow,event,sequence_number,count,value,detail" << endl;
+    } else {
+      cout << "[";
+    }
+
+    bool first = true;
+    for ( const auto & record : records ) {
+      if ( flow >= 0 and record.flow != flow ) {
+	continue;
+      }
+
+      if ( format == Format::CSV ) {
+	cout << record.timestamp << "," << record.flow << "," << event_name( record.type )
+	     << "," << record.sequence_number << "," << record.count << "," << record.value
+	     << "," << detail( record ) << "\n";
+      } else {
+	cout << (first ? "\n  " : ",\n  ");
+	write_json( record );
+      }
+      first = false;
+    }
+
+    if ( format == Format::JSON ) {
+      cout << "\n]" << endl;
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
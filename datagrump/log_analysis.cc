@@ -0,0 +1,210 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "log_analysis.hh"
+
+using namespace std;
+
+static const char BASE_TIMESTAMP[] = "# base timestamp:";
+
+void LinkStats::add( const LinkStats & other )
+{
+  capacity_bytes += other.capacity_bytes;
+  arrived_packets += other.arrived_packets;
+  arrived_bytes += other.arrived_bytes;
+  departed_packets += other.departed_packets;
+  departed_bytes += other.departed_bytes;
+  dropped_packets += other.dropped_packets;
+  queueing_delay.merge( other.queueing_delay );
+}
+
+double LinkStats::rate_mbps( const uint64_t bytes, const uint64_t duration_ms )
+{
+  return duration_ms ? bytes * 8.0 / duration_ms / 1000.0 : 0;
+}
+
+LogAnalysis::LogAnalysis( const uint64_t interval_ms, const IntervalCallback & interval_done )
+  : interval_ms_( interval_ms ),
+    interval_done_( interval_done ),
+    have_base_( false ),
+    base_ms_( 0 ),
+    last_ms_( 0 ),
+    line_number_( 0 ),
+    totals_(),
+    current_( { 0, 0, LinkStats() } ),
+    leftover_()
+{
+  if ( interval_ms_ and not interval_done_ ) {
+    throw runtime_error( "LogAnalysis: intervals need a callback" );
+  }
+}
+
+void LogAnalysis::error( const string & message ) const
+{
+  throw runtime_error( "line " + to_string( line_number_ ) + ": " + message );
+}
+
+/* split a chunk into lines, keeping any partial line for next time */
+void LogAnalysis::parse( const string & chunk )
+{
+  const char * line = chunk.data();
+  const char * const end = chunk.data() + chunk.size();
+
+  while ( line < end ) {
+    const char * newline = static_cast<const char *>( memchr( line, '\n', end - line ) );
+    if ( not newline ) {
+      leftover_.append( line, end );
+      return;
+    }
+
+    if ( leftover_.empty() ) {
+      parse_line( line, newline );
+    } else {
+      leftover_.append( line, newline );
+      parse_line( leftover_.data(), leftover_.data() + leftover_.size() );
+      leftover_.clear();
+    }
+
+    line = newline + 1;
+  }
+}
+
+void LogAnalysis::finish( void )
+{
+  /* a last line without a newline may have been cut off when the logger was killed */
+  if ( not leftover_.empty() ) {
+    try {
+      parse_line( leftover_.data(), leftover_.data() + leftover_.size() );
+    } catch ( const runtime_error & ) {}
+    leftover_.clear();
+  }
+
+  if ( interval_ms_ and have_base_ ) {
+    current_.duration_ms = last_ms_ - base_ms_ - current_.start_ms;
+    interval_done_( current_ );
+    current_ = { current_.start_ms + interval_ms_, 0, LinkStats() };
+  }
+}
+
+void LogAnalysis::parse_comment( const char * line, const char * end )
+{
+  const size_t prefix_length = sizeof( BASE_TIMESTAMP ) - 1;
+  if ( size_t( end - line ) <= prefix_length
+       or memcmp( line, BASE_TIMESTAMP, prefix_length ) ) {
+    return; /* other comments don't matter */
+  }
+
+  if ( have_base_ ) {
+    error( "base timestamp after the first event" );
+  }
+
+  const string value( line + prefix_length, end );
+  try {
+    base_ms_ = last_ms_ = stoull( value );
+  } catch ( const logic_error & ) {
+    error( "bad base timestamp" );
+  }
+  have_base_ = true;
+}
+
+/* hand back every interval that ended before time_ms
+   (an event right on the boundary belongs to the earlier interval) */
+void LogAnalysis::advance_interval( const uint64_t time_ms )
+{
+  while ( time_ms > base_ms_ + current_.start_ms + interval_ms_ ) {
+    current_.duration_ms = interval_ms_;
+    interval_done_( current_ );
+    current_ = { current_.start_ms + interval_ms_, 0, LinkStats() };
+  }
+}
+
+/* "TIME + BYTES", "TIME # BYTES", "TIME - BYTES DELAY", or "TIME d PACKETS BYTES" */
+void LogAnalysis::parse_line( const char * line, const char * end )
+{
+  line_number_++;
+
+  if ( line == end ) {
+    return;
+  }
+
+  if ( *line == '#' ) {
+    parse_comment( line, end );
+    return;
+  }
+
+  /* parse the numbers by hand (this is the hot loop for big logs) */
+  uint64_t fields[ 3 ] = { 0, 0, 0 };
+  unsigned int field_count = 0;
+  char event = 0;
+
+  const char * p = line;
+  while ( p < end ) {
+    if ( *p == ' ' or *p == '\r' ) {
+      p++;
+    } else if ( *p >= '0' and *p <= '9' ) {
+      if ( field_count == 3 ) {
+	error( "too many fields" );
+      }
+      uint64_t value = 0;
+      while ( p < end and *p >= '0' and *p <= '9' ) {
+	value = value * 10 + (*p - '0');
+	p++;
+      }
+      fields[ field_count++ ] = value;
+    } else if ( field_count == 1 and not event ) {
+      event = *p++;
+    } else {
+      error( "unexpected character" );
+    }
+  }
+
+  if ( not event or field_count < 2 ) {
+    error( "expected a time, an event, and a size" );
+  }
+
+  const uint64_t time_ms = fields[ 0 ];
+  if ( not have_base_ ) {
+    base_ms_ = time_ms;
+    have_base_ = true;
+  }
+
+  if ( time_ms < last_ms_ ) {
+    error( "timestamps must not decrease" );
+  }
+  last_ms_ = time_ms;
+
+  if ( interval_ms_ ) {
+    advance_interval( time_ms );
+  }
+
+  LinkStats * const targets[] = { &totals_, interval_ms_ ? &current_.stats : nullptr };
+
+  for ( LinkStats * stats : targets ) {
+    if ( not stats ) {
+      continue;
+    }
+
+    switch ( event ) {
+    case '+':
+      stats->arrived_packets++;
+      stats->arrived_bytes += fields[ 1 ];
+      break;
+    case '#':
+      stats->capacity_bytes += fields[ 1 ];
+      break;
+    case '-':
+      if ( field_count < 3 ) {
+	error( "departure without a delay" );
+      }
+      stats->departed_packets++;
+      stats->departed_bytes += fields[ 1 ];
+      stats->queueing_delay.add( fields[ 2 ] );
+      break;
+    case 'd':
+      stats->dropped_packets += fields[ 1 ];
+      break;
+    default:
+      error( string( "unknown event '" ) + event + "'" );
+    }
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef LOG_ANALYSIS_HH
+#define LOG_ANALYSIS_HH
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "histogram.hh"
+
+/* Totals from a mahimahi-format link log (mm-link's --uplink-log,
+   link-emulator's log=, or simulator's log=) */
+struct LinkStats
+{
+  uint64_t capacity_bytes = 0;  /* offered by delivery opportunities ('#') */
+  uint64_t arrived_packets = 0; /* '+' */
+  uint64_t arrived_bytes = 0;
+  uint64_t departed_packets = 0; /* '-' */
+  uint64_t departed_bytes = 0;
+  uint64_t dropped_packets = 0; /* 'd' */
+  Histogram queueing_delay {};  /* ms, of each departed packet */
+
+  void add( const LinkStats & other );
+
+  /* in Mbits/s over a span of milliseconds */
+  static double rate_mbps( const uint64_t bytes, const uint64_t duration_ms );
+};
+
+/* Reads a log in one pass, keeping totals for the whole run and
+   (optionally) handing back the stats for each interval of a fixed
+   length as it ends, so memory stays bounded however long the log is */
+class LogAnalysis
+{
+public:
+  struct Interval
+  {
+    uint64_t start_ms; /* relative to the base timestamp */
+    uint64_t duration_ms;
+    LinkStats stats;
+  };
+
+  typedef std::function<void( const Interval & )> IntervalCallback;
+
+private:
+  uint64_t interval_ms_; /* 0 for no intervals */
+  IntervalCallback interval_done_;
+
+  bool have_base_;
+  uint64_t base_ms_;
+  uint64_t last_ms_;
+  uint64_t line_number_;
+
+  LinkStats totals_;
+  Interval current_;
+
+  /* the partial line at the end of the last chunk */
+  std::string leftover_;
+
+  void parse_line( const char * line, const char * end );
+  void parse_comment( const char * line, const char * end );
+  void advance_interval( const uint64_t time_ms );
+  void error( const std::string & message ) const;
+
+public:
+  /* interval_done is called for each interval of interval_ms (if nonzero), in order */
+  LogAnalysis( const uint64_t interval_ms = 0, const IntervalCallback & interval_done = {} );
+
+  /* feed the next piece of the log (lines may be split across pieces) */
+  void parse( const std::string & chunk );
+
+  /* call at the end of the log */
+  void finish( void );
+
+  const LinkStats & totals( void ) const { return totals_; }
+
+  /* from the base timestamp (or the first event) to the last event */
+  uint64_t duration_ms( void ) const { return last_ms_ - base_ms_; }
+};
+
+#endif
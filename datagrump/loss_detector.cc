@@ -0,0 +1,190 @@
+#include <algorithm>
+
+#include "loss_detector.hh"
+
+using namespace std;
+
+/* how long past its RTT a datagram may go unacked (RFC 9002 kTimeThreshold) */
+static const double TIME_THRESHOLD = 9.0 / 8;
+
+/* the finest timer we count on (RFC 9002 kGranularity) */
+static const uint64_t GRANULARITY = 1000;
+
+/* bounds on the retransmission timeout (Linux's minimum; RFC 6298's maximum) */
+static const uint64_t MIN_RTO = 200 * 1000;
+static const uint64_t MAX_RTO = 60 * 1000 * 1000;
+
+LossDetector::LossDetector( const size_t capacity, const uint64_t max_ack_delay )
+  : rtt_(),
+    outstanding_( capacity ),
+    by_transmission_(),
+    next_( 0 ),
+    transmissions_( 0 ),
+    in_flight_( 0 ),
+    largest_acked_transmission_( 0 ),
+    loss_time_( 0 ),
+    last_send_time_( 0 ),
+    probes_( 0 ),
+    backoff_( 0 ),
+    max_ack_delay_( max_ack_delay ),
+    lost_(),
+    taken_()
+{}
+
+void LossDetector::sent( const uint64_t sequence_number, const uint64_t now )
+{
+  if ( not outstanding_.find( sequence_number ) ) {
+    in_flight_++;
+  }
+
+  /* a full ring forgets the oldest datagram, as if its ack never came */
+  const uint64_t evictions = outstanding_.evictions();
+  outstanding_.insert( sequence_number ) = { now, transmissions_, sequence_number < next_ };
+  in_flight_ -= outstanding_.evictions() - evictions;
+
+  by_transmission_.push_back( { transmissions_++, sequence_number } );
+  next_ = max( next_, sequence_number + 1 );
+  last_send_time_ = now;
+}
+
+bool LossDetector::acked( const uint64_t sequence_number, const uint64_t now )
+{
+  const Outstanding * datagram = outstanding_.find( sequence_number );
+  if ( not datagram ) {
+    return false;
+  }
+
+  /* too soon to be the retransmission: the ack is for an earlier copy */
+  if ( not datagram->retransmitted or now - datagram->send_time >= rtt_.min( 0 ) ) {
+    largest_acked_transmission_ = max( largest_acked_transmission_, datagram->transmission );
+  }
+  outstanding_.erase( sequence_number );
+  in_flight_--;
+  return true;
+}
+
+void LossDetector::ack_received( const uint64_t rtt, const uint64_t now )
+{
+  rtt_.update( rtt );
+
+  /* the path is working again */
+  probes_ = 0;
+  backoff_ = 0;
+
+  detect_losses( now );
+}
+
+void LossDetector::declare_lost( const uint64_t sequence_number )
+{
+  outstanding_.erase( sequence_number );
+  in_flight_--;
+  lost_.push_back( sequence_number );
+}
+
+/* has this datagram since been acked, declared lost, or sent again? */
+bool LossDetector::is_stale( const Transmission & transmission ) const
+{
+  const Outstanding * datagram = outstanding_.find( transmission.sequence_number );
+  return not datagram or datagram->transmission != transmission.transmission;
+}
+
+/* declare lost whatever was sent too long before the latest-sent datagram
+   acked, by count or by time. Both thresholds pass in the order the
+   datagrams were sent, so this stops at the first one still in time, and
+   whatever it passed (lost, or stale) is done with. */
+void LossDetector::detect_losses( const uint64_t now )
+{
+  loss_time_ = 0;
+
+  const double rtt = max<double>( rtt_.smoothed( 0 ), rtt_.latest( 0 ) );
+  const uint64_t loss_delay = max<uint64_t>( TIME_THRESHOLD * rtt, GRANULARITY );
+
+  while ( not by_transmission_.empty() ) {
+    const Transmission & oldest = by_transmission_.front();
+    if ( not is_stale( oldest ) ) {
+      if ( oldest.transmission >= largest_acked_transmission_ ) {
+	break;
+      }
+
+      const uint64_t deadline = outstanding_.find( oldest.sequence_number )->send_time + loss_delay;
+      if ( largest_acked_transmission_ - oldest.transmission < REORDERING_THRESHOLD
+	   and deadline > now ) {
+	loss_time_ = deadline;
+	break;
+      }
+
+      declare_lost( oldest.sequence_number );
+    }
+
+    by_transmission_.pop_front();
+  }
+}
+
+/* 2 SRTT, plus the receiver's ack delay if only one datagram could trigger the ack
+   (RFC 8985 section 7.2) */
+uint64_t LossDetector::probe_timeout( void ) const
+{
+  if ( not rtt_.has_sample() ) {
+    return retransmission_timeout();
+  }
+
+  const uint64_t pto = max<uint64_t>( 2 * rtt_.smoothed( 0 ), GRANULARITY );
+  return in_flight_ == 1 ? pto + max_ack_delay_ : pto;
+}
+
+/* doubled after each timeout (RFC 6298 section 5.5) */
+uint64_t LossDetector::retransmission_timeout( void ) const
+{
+  const uint64_t rto = rtt_.rto( MIN_RTO, MAX_RTO );
+  return backoff_ < 16 ? min( rto << backoff_, MAX_RTO ) : MAX_RTO;
+}
+
+uint64_t LossDetector::deadline( void ) const
+{
+  if ( loss_time_ ) {
+    return loss_time_;
+  }
+
+  if ( in_flight_ == 0 ) {
+    return 0;
+  }
+
+  return last_send_time_ + (probes_ < MAX_PROBES ? probe_timeout() : retransmission_timeout());
+}
+
+LossDetector::Timeout LossDetector::on_timer( const uint64_t now )
+{
+  const uint64_t when = deadline();
+  if ( when == 0 or now < when ) {
+    return Timeout::None;
+  }
+
+  if ( loss_time_ ) {
+    detect_losses( now );
+    return Timeout::Loss;
+  }
+
+  if ( probes_ < MAX_PROBES ) {
+    probes_++;
+    return Timeout::Probe;
+  }
+
+  /* nothing has come back for a long time: assume all of it is gone */
+  for ( const Transmission & transmission : by_transmission_ ) {
+    if ( not is_stale( transmission ) ) {
+      declare_lost( transmission.sequence_number );
+    }
+  }
+  by_transmission_.clear();
+  backoff_++;
+
+  return Timeout::RTO;
+}
+
+const vector<uint64_t> & LossDetector::take_lost( void )
+{
+  /* trade buffers, so neither has to allocate again once it has grown */
+  swap( taken_, lost_ );
+  lost_.clear();
+  return taken_;
+}
@@ -0,0 +1,107 @@
+#ifndef LOSS_DETECTOR_HH
+#define LOSS_DETECTOR_HH
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "rtt_estimator.hh"
+#include "sequence_ring.hh"
+
+/* The sender's view of which datagrams are still in flight and which
+   have been lost (all times in microseconds).
+
+   A datagram is lost once one sent REORDERING_THRESHOLD later has been
+   acked, or once it has gone unacked for 9/8 RTT while a later one was
+   acked (RFC 9002 section 6.1). "Later" is by transmission, not sequence
+   number, since a retransmission reuses its old sequence number
+   (as in RACK, RFC 8985), so the datagrams in flight are also kept in
+   the order they were sent, and each ack only looks at the oldest ones,
+   up to the first that is not yet lost. An ack of a retransmitted
+   datagram that comes sooner after the retransmission than the minimum
+   RTT must be for an earlier copy, and doesn't count as a later
+   transmission (RFC 8985 section 6.2). If acks stop coming, a probe timeout
+   asks for a tail-loss probe (RFC 8985 section 7), and after MAX_PROBES
+   of those, a retransmission timeout in the style of RFC 6298 declares
+   everything in flight lost and backs off. */
+
+class LossDetector
+{
+public:
+  enum class Timeout {
+    None,  /* nothing was due */
+    Loss,  /* the time threshold passed for some datagrams */
+    Probe, /* send one datagram (even if the window is closed) */
+    RTO    /* everything in flight was declared lost */
+  };
+
+private:
+  RTTEstimator rtt_;
+
+  /* each datagram in flight */
+  struct Outstanding {
+    uint64_t send_time;
+    uint64_t transmission; /* counts every datagram sent, retransmissions included */
+    bool retransmitted;
+  };
+
+  /* a transmission, in the order sent (stale once its datagram is
+     acked, declared lost, or sent again) */
+  struct Transmission {
+    uint64_t transmission;
+    uint64_t sequence_number;
+  };
+
+  SequenceRing<Outstanding> outstanding_;
+  std::deque<Transmission> by_transmission_;
+  uint64_t next_;          /* one past the newest datagram sent */
+  uint64_t transmissions_;
+  uint64_t in_flight_;
+
+  uint64_t largest_acked_transmission_; /* the latest-sent datagram acked (RACK.xmit_ts) */
+
+  uint64_t loss_time_;      /* when the time threshold next passes (0 if never) */
+  uint64_t last_send_time_;
+  unsigned int probes_;     /* probe timeouts since the last ack */
+  unsigned int backoff_;    /* retransmission timeouts since the last ack */
+
+  uint64_t max_ack_delay_;  /* longest the receiver holds back an ack */
+
+  std::vector<uint64_t> lost_;
+  std::vector<uint64_t> taken_; /* what take_lost() last returned */
+
+  bool is_stale( const Transmission & transmission ) const;
+  void declare_lost( const uint64_t sequence_number );
+  void detect_losses( const uint64_t now );
+
+  uint64_t probe_timeout( void ) const;
+  uint64_t retransmission_timeout( void ) const;
+
+public:
+  LossDetector( const size_t capacity, const uint64_t max_ack_delay );
+
+  /* a datagram (new, or retransmitted) was sent */
+  void sent( const uint64_t sequence_number, const uint64_t now );
+
+  /* an ack covered this datagram: returns false if it wasn't in flight */
+  bool acked( const uint64_t sequence_number, const uint64_t now );
+
+  /* after acked() for every datagram an ack covered: the RTT it measured */
+  void ack_received( const uint64_t rtt, const uint64_t now );
+
+  /* when on_timer() should next be called (0 if nothing is pending) */
+  uint64_t deadline( void ) const;
+  Timeout on_timer( const uint64_t now );
+
+  /* datagrams declared lost since the last call
+     (valid until the next call, which reuses the storage) */
+  const std::vector<uint64_t> & take_lost( void );
+
+  uint64_t in_flight( void ) const { return in_flight_; }
+  const RTTEstimator & rtt( void ) const { return rtt_; }
+
+  static const uint64_t REORDERING_THRESHOLD = 3; /* datagrams */
+  static const unsigned int MAX_PROBES = 2;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "pacer.hh"
+
+using namespace std;
+
+/* nanoseconds per millisecond */
+static const double MILLION_NS = 1000000;
+
+/* slowest we will ever pace, in datagrams per millisecond */
+static const double MIN_RATE = .01;
+
+Pacer::Pacer( const double scale, const unsigned int burst )
+  : scale_( scale ), burst_( burst ), next_release_ns_( 0 )
+{
+  if ( scale_ <= 0 or burst_ == 0 ) {
+    throw runtime_error( "Pacer: scale and burst must be positive" );
+  }
+}
+
+/* when the next burst may go out (idle time doesn't earn extra credit) */
+uint64_t Pacer::release_time( const uint64_t now_ns ) const
+{
+  return max( next_release_ns_, now_ns );
+}
+
+/* account for a burst of datagrams */
+void Pacer::released( const unsigned int count, const double rate, const uint64_t now_ns )
+{
+  const double interval_ns = MILLION_NS / (scale_ * max( rate, MIN_RATE ));
+  next_release_ns_ = release_time( now_ns ) + count * interval_ns;
+}
@@ -0,0 +1,32 @@
+#ifndef PACER_HH
+#define PACER_HH
+
+#include <cstdint>
+
+/* Spaces datagrams out to follow a pacing rate, releasing them in small bursts */
+
+class Pacer
+{
+private:
+  double scale_; /* multiplies the controller's pacing rate */
+  unsigned int burst_; /* most datagrams released at one time */
+
+  uint64_t next_release_ns_;
+
+public:
+  Pacer( const double scale, const unsigned int burst );
+
+  unsigned int burst( void ) const { return burst_; }
+
+  /* may the next burst go out now? */
+  bool ready( const uint64_t now_ns ) const { return now_ns >= next_release_ns_; }
+
+  /* when the next burst may go out (never earlier than now) */
+  uint64_t release_time( const uint64_t now_ns ) const;
+
+  /* account for a burst of datagrams released at release_time( now_ns ),
+     with the rate given in datagrams per millisecond */
+  void released( const unsigned int count, const double rate, const uint64_t now_ns );
+};
+
+#endif
@@ -1,12 +1,211 @@
-/* simple UDP receiver that acknowledges every datagram */
+/* simple UDP receiver that acknowledges every datagram (optionally with delayed, cumulative acks) */
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
 
 #include "socket.hh"
 #include "contest_message.hh"
+#include "delayed_acker.hh"
+#include "poller.hh"
+#include "util.hh"
 
 using namespace std;
+using namespace PollerShortNames;
+
+/* settings from the command line */
+struct ReceiverOptions
+{
+  bool gro = false;
+
+  /* serve the port from this many SO_REUSEPORT sockets, one thread each */
+  unsigned int threads = 1;
+
+  /* how the kernel picks a worker: by flow hash (the default),
+     by receiving CPU (BPF), or by the CPU each worker is pinned to (SO_INCOMING_CPU) */
+  enum class Steering { Hash, CPU, IncomingCPU } steering = Steering::Hash;
+
+  /* pin worker i to CPU i (modulo the number of CPUs) */
+  bool pin = false;
+
+  /* send cumulative acks (with SACK-style ranges) for every ack_every
+     datagrams, or after ack_delay_ms, instead of one ack per datagram */
+  bool delayed_acks = false;
+  unsigned int ack_every = 2;
+  uint64_t ack_delay_ms = 25;
+
+  /* parse one option, returning false if it isn't recognized */
+  bool parse( const string & option );
+};
+
+bool ReceiverOptions::parse( const string & option )
+{
+  try {
+    if ( option == "gro" ) {
+      gro = true;
+    } else if ( option == "pin" ) {
+      pin = true;
+    } else if ( option.compare( 0, 8, "threads=" ) == 0 ) {
+      threads = stoul( option.substr( 8 ) );
+      pin = pin or threads > 1;
+      return threads > 0;
+    } else if ( option == "steer=hash" ) {
+      steering = Steering::Hash;
+    } else if ( option == "steer=cpu" ) {
+      steering = Steering::CPU;
+    } else if ( option == "steer=incoming_cpu" ) {
+      steering = Steering::IncomingCPU;
+    } else if ( option.compare( 0, 10, "ack_every=" ) == 0 ) {
+      ack_every = stoul( option.substr( 10 ) );
+      delayed_acks = true;
+      return ack_every > 0;
+    } else if ( option.compare( 0, 13, "ack_delay_ms=" ) == 0 ) {
+      ack_delay_ms = stoull( option.substr( 13 ) );
+      delayed_acks = true;
+    } else {
+      return false;
+    }
+  } catch ( const logic_error & ) { /* stoul failed */
+    return false;
+  }
+
+  return true;
+}
+
+/* run the calling thread only on the given CPU */
+static void pin_to_cpu( const unsigned int cpu )
+{
+  cpu_set_t cpus;
+  CPU_ZERO( &cpus );
+  CPU_SET( cpu, &cpus );
+
+  const int error = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+  if ( error ) {
+    throw unix_error( "pthread_setaffinity_np", error );
+  }
+}
+
+/* Loop and acknowledge every incoming datagram back to its source
+   (each socket keeps its own ack sequence numbers) */
+static void acknowledge_forever( UDPSocket & socket )
+{
+  uint64_t sequence_number = 0;
+
+  /* reusable buffers to drain a burst of datagrams per syscall */
+  UDPSocket::RecvBatch batch;
+
+  while ( true ) {
+    socket.recv_batch( batch );
+
+    for ( const auto & recd : batch ) {
+      /* rewrite the header in place in the receive buffer */
+      ContestMessageView message( recd.payload, recd.length );
+
+      /* assemble the acknowledgment */
+      message.transform_into_ack( sequence_number++, recd.timestamp );
+
+      /* timestamp the ack just before sending */
+      message.set_send_timestamp();
+
+      /* send the ack */
+      socket.sendto( recd.source_address, message.data(), message.length() );
+    }
+  }
+}
+
+/* one sender's state when acks are delayed */
+struct DelayedAckFlow
+{
+  DelayedAcker acker;
+  Address source;
+
+  /* the newest datagram's header, already transformed into an ack */
+  char header[ ContestMessage::Header::LENGTH ];
+
+  /* pending delayed ack, if any */
+  Poller::TimerID timer;
+  bool timer_pending;
+
+  DelayedAckFlow( const ReceiverOptions & options, const Address & s_source )
+    : acker( options.ack_every, options.ack_delay_ms * 1000 ), source( s_source ),
+      header(), timer( 0 ), timer_pending( false )
+  {}
+};
+
+/* Loop and acknowledge incoming datagrams with cumulative acks,
+   keeping separate state for each source address */
+static void acknowledge_delayed_forever( UDPSocket & socket, const ReceiverOptions & options )
+{
+  uint64_t sequence_number = 0;
+  UDPSocket::RecvBatch batch;
+  map<string, DelayedAckFlow> flows;
+  Poller poller;
+
+  /* room for the header and the biggest AckBlock */
+  char ack[ ContestMessage::Header::LENGTH + ContestMessage::AckBlock::MAX_LENGTH ];
+
+  auto send_ack = [&] ( DelayedAckFlow & flow ) {
+    if ( flow.timer_pending ) {
+      poller.cancel_timer( flow.timer );
+      flow.timer_pending = false;
+    }
+
+    memcpy( ack, flow.header, sizeof( flow.header ) );
+    ContestMessageView message( ack, sizeof( ack ) );
+    message.set_sequence_number( sequence_number++ );
+    message.set_ack_block( flow.acker.take_ack_block() );
+
+    /* timestamp the ack just before sending */
+    message.set_send_timestamp();
+    socket.sendto( flow.source, message.data(), message.length() );
+  };
+
+  poller.add_action( Action( socket, Direction::In, [&] () {
+	socket.recv_batch( batch );
+
+	for ( const auto & recd : batch ) {
+	  ContestMessageView message( recd.payload, recd.length );
+	  const uint64_t datagram = message.sequence_number();
+
+	  auto flow = flows.find( recd.source_address.to_string() );
+	  if ( flow == flows.end() ) {
+	    flow = flows.emplace( recd.source_address.to_string(),
+				  DelayedAckFlow( options, recd.source_address ) ).first;
+	  }
+
+	  /* the ack echoes the newest datagram's timestamps */
+	  message.transform_into_ack( 0, recd.timestamp );
+	  memcpy( flow->second.header, message.data(), sizeof( flow->second.header ) );
+
+	  if ( flow->second.acker.received( datagram ) ) {
+	    send_ack( flow->second );
+	  } else if ( not flow->second.timer_pending ) {
+	    DelayedAckFlow & pending = flow->second;
+	    pending.timer_pending = true;
+	    pending.timer = poller.add_timer( pending.acker.delay_us() * 1000, [&] () {
+		pending.timer_pending = false;
+		send_ack( pending );
+		return ResultType::Continue;
+	      } );
+	  }
+	}
+
+	return ResultType::Continue;
+      } ) );
+
+  while ( true ) {
+    const auto ret = poller.poll( -1 );
+    if ( ret.result == PollResult::Exit ) {
+      throw runtime_error( "receiver: poller exited" );
+    }
+  }
+}
 
 int main( int argc, char *argv[] )
 {
@@ -15,37 +214,90 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  if ( argc != 2 ) {
-    cerr << "Usage: " << argv[ 0 ] << " PORT" << endl;
+  ReceiverOptions options;
+  bool usage_error = argc < 2;
+  for ( int i = 2; i < argc; i++ ) {
+    if ( not options.parse( argv[ i ] ) ) {
+      usage_error = true;
+    }
+  }
+
+  if ( usage_error ) {
+    cerr << "Usage: " << argv[ 0 ] << " PORT [gro] [threads=N]"
+	 << " [steer=hash|cpu|incoming_cpu] [pin] [ack_every=N] [ack_delay_ms=T]" << endl;
     return EXIT_FAILURE;
   }
 
-  /* create UDP socket for incoming datagrams */
-  UDPSocket socket;
+  try {
+    const unsigned int cpu_count = max( 1u, thread::hardware_concurrency() );
 
-  /* turn on timestamps on receipt */
-  socket.set_timestamps();
+    /* create UDP sockets for incoming datagrams, all on the same port */
+    vector<UDPSocket> sockets( options.threads );
+    for ( unsigned int i = 0; i < sockets.size(); i++ ) {
+      UDPSocket & socket = sockets[ i ];
 
-  /* "bind" the socket to the user-specified local port number */
-  socket.bind( Address( "::0", argv[ 1 ] ) );
+      /* turn on timestamps on receipt */
+      socket.set_timestamps();
 
-  cerr << "Listening on " << socket.local_address().to_string() << endl;
+      /* optionally let the kernel coalesce bursts (recv_batch splits them up) */
+      if ( options.gro ) {
+	socket.set_gro();
+      }
 
-  uint64_t sequence_number = 0;
+      if ( options.threads > 1 ) {
+	socket.set_reuseport();
+      }
 
-  /* Loop and acknowledge every incoming datagram back to its source */
-  while ( true ) {
-    const UDPSocket::received_datagram recd = socket.recv();
-    ContestMessage message = recd.payload;
+      if ( options.steering == ReceiverOptions::Steering::IncomingCPU ) {
+	socket.set_incoming_cpu( i % cpu_count );
+      }
 
-    /* assemble the acknowledgment */
-    message.transform_into_ack( sequence_number++, recd.timestamp );
+      /* "bind" the socket to the user-specified local port number */
+      socket.bind( Address( "::0", argv[ 1 ] ) );
+    }
 
-    /* timestamp the ack just before sending */
-    message.set_send_timestamp();
+    /* the program applies to the whole group, in order of binding */
+    if ( options.steering == ReceiverOptions::Steering::CPU ) {
+      sockets.front().steer_by_cpu( sockets.size() );
+    }
 
-    /* send the ack */
-    socket.sendto( recd.source_address, message.to_string() );
+    cerr << "Listening on " << sockets.front().local_address().to_string();
+    if ( options.threads > 1 ) {
+      cerr << " with " << options.threads << " threads";
+    }
+    cerr << endl;
+
+    auto serve = [&] ( UDPSocket & socket ) {
+      if ( options.delayed_acks ) {
+	acknowledge_delayed_forever( socket, options );
+      } else {
+	acknowledge_forever( socket );
+      }
+    };
+
+    /* one worker per socket (the main thread takes the first) */
+    vector<thread> workers;
+    for ( unsigned int i = 1; i < sockets.size(); i++ ) {
+      workers.emplace_back( [&, i] () {
+	  try {
+	    if ( options.pin ) {
+	      pin_to_cpu( i % cpu_count );
+	    }
+	    serve( sockets[ i ] );
+	  } catch ( const exception & e ) {
+	    print_exception( e );
+	    exit( EXIT_FAILURE );
+	  }
+	} );
+    }
+
+    if ( options.pin ) {
+      pin_to_cpu( 0 );
+    }
+    serve( sockets.front() );
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <cmath>
+
+#include "rtt_estimator.hh"
+
+using namespace std;
+
+/* gains from RFC 6298 */
+static const double ALPHA = 1.0 / 8;
+static const double BETA = 1.0 / 4;
+
+/* RFC 6298 says to start at one second */
+static const uint64_t INITIAL_RTO = 1000 * 1000;
+
+RTTEstimator::RTTEstimator()
+  : has_sample_( false ), latest_( 0 ), min_( 0 ), smoothed_( 0 ), variation_( 0 )
+{}
+
+/* account for a new sample */
+void RTTEstimator::update( const uint64_t rtt )
+{
+  if ( not has_sample_ ) {
+    has_sample_ = true;
+    min_ = rtt;
+    smoothed_ = rtt;
+    variation_ = rtt / 2.0;
+  } else {
+    min_ = std::min( min_, rtt );
+    variation_ = (1 - BETA) * variation_ + BETA * fabs( smoothed_ - rtt );
+    smoothed_ = (1 - ALPHA) * smoothed_ + ALPHA * rtt;
+  }
+
+  latest_ = rtt;
+}
+
+/* SRTT + 4 RTTVAR, clamped */
+uint64_t RTTEstimator::rto( const uint64_t min_rto, const uint64_t max_rto ) const
+{
+  const double rto = has_sample_ ? smoothed_ + 4 * variation_ : INITIAL_RTO;
+  return std::min<uint64_t>( std::max<uint64_t>( rto, min_rto ), max_rto );
+}
@@ -0,0 +1,37 @@
+#ifndef RTT_ESTIMATOR_HH
+#define RTT_ESTIMATOR_HH
+
+#include <cstdint>
+
+/* Smoothed RTT, RTT variation, and minimum RTT from a stream of samples,
+   with a retransmission timeout in the style of RFC 6298
+   (all times in microseconds) */
+
+class RTTEstimator
+{
+private:
+  bool has_sample_;
+  uint64_t latest_;
+  uint64_t min_;
+  double smoothed_;
+  double variation_;
+
+public:
+  RTTEstimator();
+
+  /* account for a new sample */
+  void update( const uint64_t rtt );
+
+  bool has_sample( void ) const { return has_sample_; }
+
+  /* these return default_rtt until there is a sample */
+  uint64_t latest( const uint64_t default_rtt ) const { return has_sample_ ? latest_ : default_rtt; }
+  uint64_t min( const uint64_t default_rtt ) const { return has_sample_ ? min_ : default_rtt; }
+  double smoothed( const uint64_t default_rtt ) const { return has_sample_ ? smoothed_ : default_rtt; }
+  double variation( void ) const { return variation_; }
+
+  /* SRTT + 4 RTTVAR, clamped to [min_rto, max_rto] (RFC 6298 section 2) */
+  uint64_t rto( const uint64_t min_rto, const uint64_t max_rto ) const;
+};
+
+#endif
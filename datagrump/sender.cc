@@ -1,40 +1,209 @@
 /* UDP sender for congestion-control contest */
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <thread>
+#include <vector>
 
 #include "socket.hh"
 #include "contest_message.hh"
 #include "controller.hh"
+#include "coupled_controller.hh"
+#include "ack_tracker.hh"
+#include "loss_detector.hh"
+#include "pacer.hh"
 #include "poller.hh"
+#include "histogram.hh"
+#include "metrics.hh"
+#include "flight_recorder.hh"
+#include "timestamp.hh"
+#include "util.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
+/* nanoseconds per microsecond and per millisecond */
+static const uint64_t THOUSAND_NS = 1000;
+static const uint64_t MILLION_NS = 1000000;
+
+/* All messages use the same dummy payload */
+static const string dummy_payload( 1424, 'x' );
+static const size_t datagram_length = ContestMessage::Header::LENGTH + dummy_payload.size();
+
+/* how far past the cumulative ack the sender remembers selective acks,
+   and most datagrams it keeps track of in flight */
+static const size_t ACK_TRACKER_CAPACITY = 16384;
+static const size_t LOSS_DETECTOR_CAPACITY = 16384;
+
+/* settings from the command line */
+struct SenderOptions
+{
+  bool debug = false;
+
+  /* stage the whole open window and send it with one syscall
+     (segmented by the kernel if GSO is on) */
+  bool batch = false;
+  bool gso = false;
+  bool gro = false;
+
+  /* how the event loop waits for the socket */
+  bool epoll = false;
+  bool edge_triggered = false;
+
+  /* space datagrams out at the controller's pacing rate,
+     either with timers or by giving the kernel release times
+     (pacing_scale multiplies the rate the controller asks for, which
+     may already include the controller's own gain, e.g. cc.pacing_gain) */
+  bool pace = false;
+  bool txtime = false;
+  double pacing_scale = 1.0;
+  unsigned int burst = 2;
+
+  /* read the clock from the TSC */
+  bool tsc = false;
+
+  /* send lost datagrams again (with their old sequence numbers)
+     ahead of new ones */
+  bool retransmit = false;
+
+  /* the longest the receiver may hold back an ack (its ack_delay_ms) */
+  uint64_t ack_delay_ms = 25;
+
+  /* which congestion controller to use (a list is used round-robin
+     across flows), and its settings */
+  string cc = "bbrish";
+  ControllerParams cc_params {};
+
+  /* run several flows (each with its own socket and controller) on
+     this many threads, starting stagger_ms apart, and report on them
+     after duration_s (by default, one flow runs forever) */
+  unsigned int flows = 1;
+  unsigned int threads = 1;
+  uint64_t stagger_ms = 0;
+  double duration_s = 0;
+  uint64_t interval_ms = 1000; /* for the fairness-over-time report */
+
+  /* couple the flows that use the same controller: one controller
+     instance serves them all, and each flow gets a share of its window
+     in proportion to its weight (a list is used round-robin) */
+  bool coupled = false;
+  string weights = "1";
+
+  /* append counters and latency histograms to this file (as JSON lines)
+     every metrics_interval_ms */
+  string metrics {};
+  uint64_t metrics_interval_ms = 1000;
+
+  /* log every event to a binary ring file of this many records
+     (read it with flight-decoder) */
+  string record {};
+  size_t record_size = 1 << 20;
+
+  /* parse one option, returning false if it isn't recognized */
+  bool parse( const string & option );
+};
+
+/* what one flow did, for the multi-flow report */
+struct FlowStats
+{
+  uint64_t datagrams_sent = 0;
+  uint64_t datagrams_acked = 0;
+  uint64_t datagrams_lost = 0;
+  Histogram rtt {}; /* us */
+  vector<uint64_t> acked_per_interval {};
+};
+
 /* simple sender class to handle the accounting */
 class DatagrumpSender
 {
 private:
+  uint16_t flow_; /* for the flight recorder */
+  string cc_;
   UDPSocket socket_;
-  Controller controller_; /* your class */
+  UDPSocket::RecvBatch recv_batch_; /* reusable buffers for incoming acks */
+  unique_ptr<Controller> controller_; /* your class */
+
+  SenderOptions options_;
+  UDPSocket::SendBatch send_batch_;
+  Pacer pacer_;
+
+  uint64_t sequence_number_; /* next new sequence number */
+  uint64_t next_unsent_;     /* one past the newest datagram actually sent */
+
+  /* which datagrams have been acked, for counting what each ack covers */
+  AckTracker ack_tracker_;
 
-  uint64_t sequence_number_; /* next outgoing sequence number */
+  /* which datagrams are in flight, and which have been lost */
+  LossDetector loss_detector_;
+  deque<uint64_t> retransmissions_; /* lost datagrams to send again */
 
-  /* if network does not reorder or lose datagrams,
-     this is the sequence number that the sender
-     next expects will be acknowledged by the receiver */
-  uint64_t next_ack_expected_;
+  /* timers in the event loop */
+  Poller::TimerID silence_timer_;
+  Poller::TimerID loss_timer_;
+  uint64_t loss_deadline_;
+  Poller::TimerID pacing_timer_;
 
+  FlowStats stats_;
+  uint64_t stats_origin_; /* when interval 0 of acked_per_interval began */
+
+  /* the window as of the last send decision (asking the controller
+     again could change its state), and what the flight recorder last
+     heard it was */
+  unsigned int window_;
+  unsigned int recorded_window_;
+  double recorded_pacing_rate_;
+
+  uint64_t next_datagram( void );
+  void datagram_sent( const uint64_t sequence_number, const uint64_t send_timestamp );
+  void record_window( const uint64_t timestamp );
   void send_datagram( void );
-  void got_ack( const uint64_t timestamp, const ContestMessage & msg );
+  void stage_datagram( const uint64_t txtime_ns );
+  void flush_datagrams( void );
+  void send_window_batched( void );
+  void send_window_paced( void );
+  void got_ack( const uint64_t timestamp, const ContestMessageView & msg );
+  void loss_timer_expired( void );
+  void report_losses( const uint64_t timestamp, const bool timeout );
   bool window_is_open( void );
+  bool paced_by_timers( void ) const { return options_.pace and not options_.txtime; }
 
 public:
   DatagrumpSender( const char * const host, const char * const port,
-		   const bool debug );
+		   const SenderOptions & options, const uint16_t flow, const string & cc,
+		   unique_ptr<Controller> && controller );
+
+  /* run alone, forever */
   int loop( void );
+
+  /* or share an event loop: register with it, then call prepare() before each poll */
+  void attach( Poller & poller, const uint64_t stats_origin );
+  void prepare( Poller & poller );
+
+  const string & cc( void ) const { return cc_; }
+  const FlowStats & stats( void ) const { return stats_; }
 };
 
+static int run_flows( const char * const host, const char * const port,
+		      const SenderOptions & options );
+
+/* "a,b,c" -> { "a", "b", "c" } */
+static vector<string> split_list( const string & list )
+{
+  vector<string> ret;
+  for ( size_t start = 0; start <= list.size(); ) {
+    const size_t comma = min( list.find( ',', start ), list.size() );
+    ret.push_back( list.substr( start, comma - start ) );
+    start = comma + 1;
+  }
+  return ret;
+}
+
 int main( int argc, char *argv[] )
 {
    /* check the command-line arguments */
@@ -42,114 +211,765 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  bool debug = false;
-  if ( argc == 4 and string( argv[ 3 ] ) == "debug" ) {
-    debug = true;
-  } else if ( argc == 3 ) {
-    /* do nothing */
-  } else {
-    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [debug]" << endl;
+  SenderOptions options;
+  bool usage_error = argc < 3;
+  for ( int i = 3; i < argc; i++ ) {
+    if ( not options.parse( argv[ i ] ) ) {
+      usage_error = true;
+    }
+  }
+
+  if ( usage_error ) {
+    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [debug] [batch] [gso] [gro] [epoll] [edge]"
+	 << " [pace] [txtime] [pacing_scale=SCALE] [burst=DATAGRAMS] [tsc] [retransmit]"
+	 << " [ack_delay_ms=T]"
+	 << " [cc=NAME[,NAME...]] [cc.PARAM=VALUE]..."
+	 << " [flows=N] [threads=N] [stagger=MS] [duration=SECONDS] [interval=MS]"
+	 << " [couple] [weights=W[,W...]] [metrics=FILE] [metrics_interval=MS]"
+	 << " [record=FILE] [record_size=RECORDS]" << endl;
+    cerr << "(the pace is the controller's pacing rate, including any cc.pacing_gain,"
+	 << " times pacing_scale)" << endl;
+    cerr << "Controllers:";
+    for ( const auto & name : controller_names() ) {
+      cerr << " " << name;
+    }
+    cerr << endl;
     return EXIT_FAILURE;
   }
 
-  /* create sender object to handle the accounting */
-  /* all the interesting work is done by the Controller */
-  DatagrumpSender sender( argv[ 1 ], argv[ 2 ], debug );
-  return sender.loop();
+  if ( options.tsc and not use_tsc_clock() ) {
+    cerr << "TSC is not invariant on this machine; using clock_gettime" << endl;
+  }
+
+  try {
+    unique_ptr<FlightRecorder> recorder;
+    if ( not options.record.empty() ) {
+      recorder.reset( new FlightRecorder( options.record, options.record_size ) );
+    }
+
+    unique_ptr<MetricsExporter> metrics;
+    if ( not options.metrics.empty() ) {
+      metrics.reset( new MetricsExporter( options.metrics, options.metrics_interval_ms ) );
+    }
+
+    if ( options.flows > 1 or options.duration_s > 0 ) {
+      return run_flows( argv[ 1 ], argv[ 2 ], options );
+    }
+
+    /* create sender object to handle the accounting */
+    /* all the interesting work is done by the Controller */
+    DatagrumpSender sender( argv[ 1 ], argv[ 2 ], options, 0, options.cc,
+			    make_controller( options.cc, options.debug, options.cc_params ) );
+    return sender.loop();
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+}
+
+/* parse one option, returning false if it isn't recognized */
+bool SenderOptions::parse( const string & option )
+{
+  const size_t equals = option.find( '=' );
+  const string name = option.substr( 0, equals );
+  const string value = equals == string::npos ? "" : option.substr( equals + 1 );
+
+  try {
+    if ( option == "debug" ) {
+      debug = true;
+    } else if ( option == "batch" ) {
+      batch = true;
+    } else if ( option == "gso" ) {
+      batch = gso = true;
+    } else if ( option == "gro" ) {
+      gro = true;
+    } else if ( option == "epoll" ) {
+      epoll = true;
+    } else if ( option == "edge" ) {
+      epoll = edge_triggered = true;
+    } else if ( option == "pace" ) {
+      pace = true;
+    } else if ( option == "txtime" ) {
+      pace = txtime = true;
+    } else if ( option == "tsc" ) {
+      tsc = true;
+    } else if ( option == "retransmit" ) {
+      retransmit = true;
+    } else if ( name == "pacing_scale" and not value.empty() ) {
+      pacing_scale = stod( value );
+      return pacing_scale > 0;
+    } else if ( name == "ack_delay_ms" and not value.empty() ) {
+      ack_delay_ms = stoull( value );
+    } else if ( name == "burst" and not value.empty() ) {
+      burst = stoul( value );
+      return burst > 0;
+    } else if ( name == "cc" and not value.empty() ) {
+      cc = value;
+    } else if ( name.compare( 0, 3, "cc." ) == 0 and name.size() > 3 and not value.empty() ) {
+      cc_params.set( name.substr( 3 ), value );
+    } else if ( name == "flows" and not value.empty() ) {
+      flows = stoul( value );
+      return flows > 0;
+    } else if ( name == "threads" and not value.empty() ) {
+      threads = stoul( value );
+      return threads > 0;
+    } else if ( name == "stagger" and not value.empty() ) {
+      stagger_ms = stoull( value );
+    } else if ( name == "duration" and not value.empty() ) {
+      duration_s = stod( value );
+      return duration_s > 0;
+    } else if ( name == "interval" and not value.empty() ) {
+      interval_ms = stoull( value );
+      return interval_ms > 0;
+    } else if ( name == "metrics" and not value.empty() ) {
+      metrics = value;
+    } else if ( name == "metrics_interval" and not value.empty() ) {
+      metrics_interval_ms = stoull( value );
+      return metrics_interval_ms > 0;
+    } else if ( name == "record" and not value.empty() ) {
+      record = value;
+    } else if ( name == "record_size" and not value.empty() ) {
+      record_size = stoull( value );
+      return record_size > 0;
+    } else if ( option == "couple" ) {
+      coupled = true;
+    } else if ( name == "weights" and not value.empty() ) {
+      weights = value;
+      for ( const string & weight : split_list( weights ) ) {
+	if ( not (stod( weight ) > 0) ) {
+	  return false;
+	}
+      }
+    } else {
+      return false;
+    }
+  } catch ( const logic_error & ) { /* stod or stoul failed */
+    return false;
+  }
+
+  return true;
 }
 
 DatagrumpSender::DatagrumpSender( const char * const host,
 				  const char * const port,
-				  const bool debug )
-  : socket_(),
-    controller_( debug ),
+				  const SenderOptions & options,
+				  const uint16_t flow,
+				  const string & cc,
+				  unique_ptr<Controller> && controller )
+  : flow_( flow ),
+    cc_( cc ),
+    socket_(),
+    recv_batch_(),
+    controller_( move( controller ) ),
+    options_( options ),
+    send_batch_(),
+    pacer_( options.pacing_scale, options.burst ),
     sequence_number_( 0 ),
-    next_ack_expected_( 0 )
+    next_unsent_( 0 ),
+    ack_tracker_( ACK_TRACKER_CAPACITY ),
+    loss_detector_( LOSS_DETECTOR_CAPACITY, options.ack_delay_ms * 1000 ),
+    retransmissions_(),
+    silence_timer_( -1 ),
+    loss_timer_( -1 ),
+    loss_deadline_( 0 ),
+    pacing_timer_( -1 ),
+    stats_(),
+    stats_origin_( 0 ),
+    window_( 0 ),
+    recorded_window_( 0 ),
+    recorded_pacing_rate_( 0 )
 {
+  controller_->set_flow( flow_ );
+
   /* turn on timestamps when socket receives a datagram */
   socket_.set_timestamps();
 
+  /* optionally let the kernel split and coalesce datagrams for us */
+  if ( options_.gso ) {
+    socket_.set_gso();
+  }
+
+  if ( options_.gro ) {
+    socket_.set_gro();
+  }
+
+  /* optionally let the kernel (fq qdisc) hold each datagram until its release time */
+  if ( options_.txtime ) {
+    socket_.set_txtime();
+  }
+
   /* connect socket to the remote host */
   /* (note: this doesn't send anything; it just tags the socket
      locally with the remote address */
   socket_.connect( Address( host, port ) );  
 
-  cerr << "Sending to " << socket_.peer_address().to_string() << endl;
+  cerr << "Sending to " << socket_.peer_address().to_string()
+       << " with controller " << cc_;
+  if ( not options_.cc_params.to_string().empty() ) {
+    cerr << " (" << options_.cc_params.to_string() << ")";
+  }
+  cerr << endl;
 }
 
 void DatagrumpSender::got_ack( const uint64_t timestamp,
-			       const ContestMessage & ack )
+			       const ContestMessageView & ack )
 {
   if ( not ack.is_ack() ) {
     throw runtime_error( "sender got something other than an ack from the receiver" );
   }
 
-  /* Update sender's counter */
-  next_ack_expected_ = max( next_ack_expected_,
-			    ack.header.ack_sequence_number + 1 );
+  LatencyTimer timer( Latency::AckProcessing );
+  count_event( Counter::AcksReceived );
+
+  /* a plain ack covers one datagram; a cumulative one may cover several */
+  const auto no_longer_in_flight = [&] ( const uint64_t sequence_number ) {
+    loss_detector_.acked( sequence_number, timestamp );
+  };
+  const uint64_t newly_acked = ack.has_ack_block()
+    ? ack_tracker_.acked( ack.ack_block(), no_longer_in_flight )
+    : ack_tracker_.acked( ack.ack_sequence_number(), no_longer_in_flight );
+
+  /* the ack echoes the send timestamp of the transmission it acks,
+     so even retransmissions give a true RTT sample */
+  const uint64_t rtt = max<uint64_t>( timestamp - ack.ack_send_timestamp(), 1 );
+  loss_detector_.ack_received( rtt, timestamp );
+  flight_record( timestamp, FlightEvent::Acked, flow_, ack.ack_sequence_number(),
+		 newly_acked, rtt );
+  record_latency( Latency::RTT, rtt * 1000 );
+  record_latency( Latency::QueueingDelay, (rtt - loss_detector_.rtt().min( rtt )) * 1000 );
+
+  /* keep score */
+  stats_.datagrams_acked += newly_acked;
+  stats_.rtt.add( rtt );
+  if ( timestamp >= stats_origin_ ) {
+    const size_t interval = (timestamp - stats_origin_) / (options_.interval_ms * 1000);
+    if ( stats_.acked_per_interval.size() <= interval ) {
+      stats_.acked_per_interval.resize( interval + 1 );
+    }
+    stats_.acked_per_interval[ interval ] += newly_acked;
+  }
 
   /* Inform congestion controller */
-  controller_.ack_received( ack.header.ack_sequence_number,
-			    ack.header.ack_send_timestamp,
-			    ack.header.ack_recv_timestamp,
-			    timestamp, sequence_number_ );
+  controller_->ack_received( { ack.ack_sequence_number(),
+			       ack.ack_send_timestamp(),
+			       ack.ack_recv_timestamp(),
+			       timestamp,
+			       ack_tracker_.cumulative_ack(),
+			       newly_acked },
+			     sequence_number_ );
+
+  report_losses( timestamp, false );
+  record_window( timestamp );
 }
 
-void DatagrumpSender::send_datagram( void )
+/* The loss detector's deadline passed */
+void DatagrumpSender::loss_timer_expired( void )
+{
+  const uint64_t now = timestamp_us();
+  const LossDetector::Timeout timeout = loss_detector_.on_timer( now );
+  if ( timeout != LossDetector::Timeout::None ) {
+    count_event( Counter::Timeouts );
+    flight_record( now, FlightEvent::Timeout, flow_, 0,
+		   uint32_t( timeout == LossDetector::Timeout::Loss ? FlightTimeout::Loss
+			     : timeout == LossDetector::Timeout::Probe ? FlightTimeout::Probe
+			     : FlightTimeout::RTO ), 0 );
+  }
+
+  if ( timeout == LossDetector::Timeout::Probe ) {
+    /* a tail-loss probe: one more datagram to draw out an ack */
+    send_datagram();
+  }
+
+  report_losses( now, timeout == LossDetector::Timeout::RTO );
+  record_window( now );
+}
+
+/* Tell the controller about newly lost datagrams, and forget them
+   (or queue them to be sent again) */
+void DatagrumpSender::report_losses( const uint64_t timestamp, const bool timeout )
 {
-  /* All messages use the same dummy payload */
-  static const string dummy_payload( 1424, 'x' );
+  const vector<uint64_t> & lost = loss_detector_.take_lost();
+  if ( lost.empty() ) {
+    return;
+  }
+
+  stats_.datagrams_lost += lost.size();
+  const uint64_t largest_lost = *max_element( lost.begin(), lost.end() );
 
-  ContestMessage cm( sequence_number_++, dummy_payload );
-  controller_.increment_sequence_number();
+  for ( const uint64_t sequence_number : lost ) {
+    if ( options_.retransmit ) {
+      retransmissions_.push_back( sequence_number );
+    } else {
+      ack_tracker_.give_up( sequence_number );
+    }
+  }
+
+  flight_record( timestamp, FlightEvent::Lost, flow_, largest_lost, lost.size(),
+		 loss_detector_.in_flight() );
+
+  controller_->datagrams_lost( { timestamp,
+				 largest_lost,
+				 lost.size(),
+				 loss_detector_.in_flight(),
+				 timeout },
+			       sequence_number_ );
+}
+
+/* Sequence number for the next datagram: a lost one to send again, or a new one */
+uint64_t DatagrumpSender::next_datagram( void )
+{
+  while ( not retransmissions_.empty() ) {
+    const uint64_t sequence_number = retransmissions_.front();
+    retransmissions_.pop_front();
+
+    /* a late ack may have come in after all */
+    if ( not ack_tracker_.is_acked( sequence_number ) ) {
+      return sequence_number;
+    }
+  }
+
+  return sequence_number_++;
+}
+
+void DatagrumpSender::send_datagram( void )
+{
+  ContestMessage cm( next_datagram(), dummy_payload );
   cm.set_send_timestamp();
   socket_.send( cm.to_string() );
+  datagram_sent( cm.header.sequence_number, cm.header.send_timestamp );
+}
 
-  /* Inform congestion controller */
-  controller_.datagram_was_sent( cm.header.sequence_number,
-				 cm.header.send_timestamp );
+/* Inform loss detector and congestion controller, and keep score */
+void DatagrumpSender::datagram_sent( const uint64_t sequence_number,
+				     const uint64_t send_timestamp )
+{
+  stats_.datagrams_sent++;
+  count_event( Counter::DatagramsSent );
+  flight_record( send_timestamp, FlightEvent::Sent, flow_, sequence_number,
+		 sequence_number < next_unsent_, datagram_length );
+  next_unsent_ = max( next_unsent_, sequence_number + 1 );
+
+  loss_detector_.sent( sequence_number, send_timestamp );
+  controller_->datagram_was_sent( sequence_number, send_timestamp, datagram_length );
+  record_window( send_timestamp );
+}
+
+/* Tell the flight recorder if the window the sender last used, or the pacing rate, changed */
+void DatagrumpSender::record_window( const uint64_t timestamp )
+{
+  if ( not flight_recording() ) {
+    return;
+  }
+
+  const double pacing_rate = controller_->pacing_rate();
+  if ( window_ != recorded_window_ or pacing_rate != recorded_pacing_rate_ ) {
+    flight_record( timestamp, FlightEvent::Window, flow_, 0, window_, pacing_rate * 1000 );
+    recorded_window_ = window_;
+    recorded_pacing_rate_ = pacing_rate;
+  }
+}
+
+/* Write the next datagram directly into the batch's buffer */
+void DatagrumpSender::stage_datagram( const uint64_t txtime_ns )
+{
+  ContestMessageView message( send_batch_.stage( datagram_length, txtime_ns ), datagram_length );
+  message.initialize_header( next_datagram() );
+  memcpy( message.payload(), dummy_payload.data(), dummy_payload.size() );
+}
+
+/* Stamp and send everything staged with one syscall, then inform the controller */
+void DatagrumpSender::flush_datagrams( void )
+{
+  if ( send_batch_.empty() ) {
+    return;
+  }
+
+  /* one clock reading stamps the whole batch just before it goes out
+     (datagrams with a release time are stamped with when they will leave) */
+  const uint64_t now_us = timestamp_us();
+  const uint64_t now_ns = Poller::now_ns();
+  vector<pair<uint64_t, uint64_t>> sent; /* sequence number, send timestamp */
+  sent.reserve( send_batch_.size() );
+
+  for ( size_t i = 0; i < send_batch_.size(); i++ ) {
+    const uint64_t txtime_ns = send_batch_.txtime( i );
+    const uint64_t send_timestamp = txtime_ns > now_ns
+      ? now_us + (txtime_ns - now_ns) / THOUSAND_NS
+      : now_us;
+
+    ContestMessageView message( send_batch_.datagram( i ), send_batch_.length( i ) );
+    message.set_send_timestamp( send_timestamp );
+    sent.emplace_back( message.sequence_number(), send_timestamp );
+  }
+
+  socket_.send_batch( send_batch_ );
+
+  for ( const auto & datagram : sent ) {
+    datagram_sent( datagram.first, datagram.second );
+  }
+}
+
+/* Stage every datagram the window allows, then send them with one syscall */
+void DatagrumpSender::send_window_batched( void )
+{
+  while ( window_is_open() ) {
+    while ( window_is_open() and send_batch_.has_room( datagram_length ) ) {
+      stage_datagram( 0 );
+    }
+
+    flush_datagrams();
+  }
+}
+
+/* Send what the window and the pacing schedule allow */
+void DatagrumpSender::send_window_paced( void )
+{
+  const uint64_t now = Poller::now_ns();
+
+  if ( options_.txtime ) {
+    /* hand the kernel the whole window, each burst tagged with its release time */
+    while ( window_is_open() ) {
+      const uint64_t release = pacer_.release_time( now );
+      unsigned int count = 0;
+      while ( count < pacer_.burst()
+	      and window_is_open()
+	      and send_batch_.has_room( datagram_length ) ) {
+	stage_datagram( release );
+	count++;
+      }
+
+      pacer_.released( count, controller_->pacing_rate(), now );
+
+      if ( not send_batch_.has_room( datagram_length ) ) {
+	flush_datagrams();
+      }
+    }
+  } else if ( pacer_.ready( now ) ) {
+    /* release one burst now; a timer brings us back for the next */
+    unsigned int count = 0;
+    while ( count < pacer_.burst() and window_is_open() ) {
+      stage_datagram( 0 );
+      count++;
+    }
+
+    pacer_.released( count, controller_->pacing_rate(), now );
+  }
+
+  flush_datagrams();
 }
 
 bool DatagrumpSender::window_is_open( void )
 {
-  return sequence_number_ - next_ack_expected_ < controller_.window_size();
+  window_ = controller_->window_size();
+  return loss_detector_.in_flight() < window_;
 }
 
-int DatagrumpSender::loop( void )
+/* Register the sender's rules with an event loop (which may be shared with other flows) */
+void DatagrumpSender::attach( Poller & poller, const uint64_t stats_origin )
 {
-  /* read and write from the receiver using an event-driven "poller" */
-  Poller poller;
+  stats_origin_ = stats_origin;
 
-  /* first rule: if the window is open, close it by
+  /* first rule: if the window is open (and the pacer allows), close it by
      sending more datagrams */
-  poller.add_action( Action( socket_, Direction::Out, [&] () {
+  poller.add_action( Action( socket_, Direction::Out, [this] () {
 	/* Close the window */
-	while ( window_is_open() ) {
-	  send_datagram();
+	if ( options_.pace ) {
+	  send_window_paced();
+	} else if ( options_.batch ) {
+	  send_window_batched();
+	} else {
+	  while ( window_is_open() ) {
+	    send_datagram();
+	  }
 	}
 	return ResultType::Continue;
       },
       /* We're only interested in this rule when the window is open */
-      [&] () { return window_is_open(); } ) );
+      [this] () { return window_is_open()
+	  and (not paced_by_timers() or pacer_.ready( Poller::now_ns() )); } ) );
 
-  /* second rule: if sender receives an ack,
-     process it and inform the controller
+  /* second rule: after a stretch with no acks, send one datagram
+     to try to get things moving again */
+  silence_timer_ = poller.add_timer( controller_->timeout_ms() * MILLION_NS, [this, &poller] () {
+      count_event( Counter::Timeouts );
+      flight_record( timestamp_us(), FlightEvent::Timeout, flow_, 0,
+		     uint32_t( FlightTimeout::Silence ), 0 );
+      send_datagram();
+      poller.mark_dirty( socket_ );
+      return ResultType::Continue;
+    }, controller_->timeout_ms() * MILLION_NS );
+
+  /* third rule: if sender receives acks,
+     process the whole burst and inform the controller
      (by using the sender's got_ack method) */
-  poller.add_action( Action( socket_, Direction::In, [&] () {
-	const UDPSocket::received_datagram recd = socket_.recv();
-	const ContestMessage ack  = recd.payload;
-	got_ack( recd.timestamp, ack );
+  poller.add_action( Action( socket_, Direction::In, [this, &poller] () {
+	poller.reschedule_timer( silence_timer_, controller_->timeout_ms() * MILLION_NS );
+
+	/* (edge-triggered wakeups only come once, so drain the socket) */
+	while ( socket_.recv_batch( recv_batch_, not options_.edge_triggered ) ) {
+	  for ( const auto & recd : recv_batch_ ) {
+	    got_ack( recd.timestamp, ContestMessageView( recd.payload, recd.length ) );
+	  }
+
+	  if ( not options_.edge_triggered ) {
+	    break;
+	  }
+	}
 	return ResultType::Continue;
       } ) );
+}
 
-  /* Run these two rules forever */
+/* Keep the timers that depend on the sender's state up to date (call before each poll) */
+void DatagrumpSender::prepare( Poller & poller )
+{
+  /* fourth rule: when the loss detector's deadline passes, declare
+     datagrams lost or send a tail-loss probe */
+  const uint64_t deadline = loss_detector_.deadline();
+  if ( deadline != loss_deadline_ or (deadline and not poller.timer_pending( loss_timer_ )) ) {
+    poller.cancel_timer( loss_timer_ );
+    loss_deadline_ = deadline;
+    if ( deadline ) {
+      const uint64_t now = timestamp_us();
+      loss_timer_ = poller.add_timer( deadline > now ? (deadline - now) * THOUSAND_NS : 0,
+				      [this, &poller] () {
+					loss_timer_expired();
+					poller.mark_dirty( socket_ );
+					return ResultType::Continue;
+				      } );
+    }
+  }
+
+  /* when pacing with timers, wake up as soon as the next burst may go */
+  if ( paced_by_timers() and window_is_open() and not poller.timer_pending( pacing_timer_ ) ) {
+    const uint64_t now = Poller::now_ns();
+    if ( not pacer_.ready( now ) ) {
+      /* the Out rule will notice the pacer is ready once this fires */
+      pacing_timer_ = poller.add_timer( pacer_.release_time( now ) - now,
+					[this, &poller] () {
+					  poller.mark_dirty( socket_ );
+					  return ResultType::Continue;
+					} );
+    }
+  }
+
+  /* a coupled flow's window also moves with the acks of the flows it shares with */
+  if ( options_.coupled ) {
+    poller.mark_dirty( socket_ );
+  }
+}
+
+int DatagrumpSender::loop( void )
+{
+  /* read and write from the receiver using an event-driven "poller" */
+  Poller poller( options_.epoll ? Poller::Backend::Epoll : Poller::Backend::Poll,
+		 options_.edge_triggered );
+  attach( poller, timestamp_us() );
+
+  /* Run these rules forever */
   while ( true ) {
-    const auto ret = poller.poll( controller_.timeout_ms() );
+    prepare( poller );
+
+    const auto ret = poller.poll( -1 );
     if ( ret.result == PollResult::Exit ) {
       return ret.exit_status;
-    } else if ( ret.result == PollResult::Timeout ) {
-      /* After a timeout, send one datagram to try to get things moving again */
-      send_datagram();
     }
   }
 }
+
+/* Jain's fairness index over each flow's rate per unit of weight: 1 when
+   every flow gets its share, 1/n when one gets it all */
+static double jain_index( const vector<double> & rates, const vector<double> & weights )
+{
+  double sum = 0, sum_of_squares = 0;
+  for ( size_t i = 0; i < rates.size(); i++ ) {
+    const double share = rates[ i ] / weights[ i ];
+    sum += share;
+    sum_of_squares += share * share;
+  }
+
+  return sum_of_squares > 0 ? sum * sum / (rates.size() * sum_of_squares) : 1;
+}
+
+/* Run one thread's share of the flows on a shared event loop until end
+   (each flow starts at its own time, in timestamp_us) */
+static void run_flow_group( const vector<DatagrumpSender *> & flows,
+			    const vector<uint64_t> & start_times,
+			    const uint64_t origin, const uint64_t end,
+			    const SenderOptions & options )
+{
+  Poller poller( options.epoll ? Poller::Backend::Epoll : Poller::Backend::Poll,
+		 options.edge_triggered );
+  size_t started = 0;
+
+  while ( true ) {
+    const uint64_t now = timestamp_us();
+    if ( now >= end ) {
+      return;
+    }
+
+    /* (flows are attached between polls, never from inside a callback) */
+    while ( started < flows.size() and start_times[ started ] <= now ) {
+      flows[ started ]->attach( poller, origin );
+      started++;
+    }
+
+    const uint64_t wakeup = started < flows.size() ? min( start_times[ started ], end ) : end;
+    const int timeout_ms = (wakeup - now + 999) / 1000;
+
+    if ( started == 0 ) {
+      this_thread::sleep_for( chrono::microseconds( wakeup - now ) );
+      continue;
+    }
+
+    for ( size_t i = 0; i < started; i++ ) {
+      flows[ i ]->prepare( poller );
+    }
+
+    const auto ret = poller.poll( timeout_ms );
+    if ( ret.result == PollResult::Exit ) {
+      return;
+    }
+  }
+}
+
+/* Run options.flows flows for options.duration_s (by default, forever),
+   then report on each of them and on how fairly they shared */
+static int run_flows( const char * const host, const char * const port,
+		      const SenderOptions & options )
+{
+  const vector<string> ccs = split_list( options.cc );
+  const vector<string> weights = split_list( options.weights );
+
+  /* what each flow is entitled to (only coupled flows are weighted) */
+  vector<double> flow_weights;
+
+  /* when coupled, one bottleneck for each controller */
+  vector<shared_ptr<SharedBottleneck>> bottlenecks;
+  map<string, size_t> bottleneck_index;
+  vector<size_t> bottleneck_of_flow;
+
+  vector<unique_ptr<DatagrumpSender>> flows;
+  for ( unsigned int i = 0; i < options.flows; i++ ) {
+    const string & cc = ccs[ i % ccs.size() ];
+    if ( not options.coupled ) {
+      flow_weights.push_back( 1 );
+      flows.emplace_back( new DatagrumpSender( host, port, options, i, cc,
+					       make_controller( cc, options.debug,
+								options.cc_params ) ) );
+      continue;
+    }
+
+    if ( not bottleneck_index.count( cc ) ) {
+      bottleneck_index[ cc ] = bottlenecks.size();
+      bottlenecks.push_back( make_shared<SharedBottleneck>( make_controller( cc, options.debug,
+									     options.cc_params ) ) );
+    }
+    bottleneck_of_flow.push_back( bottleneck_index[ cc ] );
+    const auto & bottleneck = bottlenecks[ bottleneck_of_flow.back() ];
+
+    const string & weight = weights[ i % weights.size() ];
+    flow_weights.push_back( stod( weight ) );
+    flows.emplace_back( new DatagrumpSender( host, port, options, i,
+					     cc + ", coupled, weight " + weight,
+					     unique_ptr<Controller>(
+					       new CoupledController( bottleneck,
+								      flow_weights.back() ) ) ) );
+  }
+
+  const uint64_t origin = timestamp_us();
+  const uint64_t duration = options.duration_s > 0
+    ? options.duration_s * 1000 * 1000
+    : numeric_limits<uint64_t>::max() - origin;
+  const uint64_t end = origin + duration;
+  const auto start_time = [&] ( const unsigned int flow ) {
+    return origin + flow * options.stagger_ms * 1000;
+  };
+
+  /* deal the flows out to the threads (keeping coupled flows together);
+     the main thread runs the first group */
+  const unsigned int thread_count = min<unsigned int>( options.threads,
+						       options.coupled ? bottlenecks.size()
+						       : options.flows );
+  vector<vector<DatagrumpSender *>> groups( thread_count );
+  vector<vector<uint64_t>> start_times( thread_count );
+  for ( unsigned int i = 0; i < options.flows; i++ ) {
+    const unsigned int group = (options.coupled ? bottleneck_of_flow[ i ] : i) % thread_count;
+    groups[ group ].push_back( flows[ i ].get() );
+    start_times[ group ].push_back( start_time( i ) );
+  }
+
+  vector<thread> workers;
+  for ( unsigned int t = 1; t < thread_count; t++ ) {
+    workers.emplace_back( [&, t] () {
+	try {
+	  run_flow_group( groups[ t ], start_times[ t ], origin, end, options );
+	} catch ( const exception & e ) {
+	  print_exception( e );
+	  exit( EXIT_FAILURE );
+	}
+      } );
+  }
+
+  run_flow_group( groups[ 0 ], start_times[ 0 ], origin, end, options );
+  for ( auto & worker : workers ) {
+    worker.join();
+  }
+
+  /* per flow, over the time it was running */
+  const double bits_per_datagram = datagram_length * 8.0;
+  vector<double> rates;
+  uint64_t total_acked = 0;
+
+  cout << fixed;
+  cout.precision( 2 );
+
+  for ( unsigned int i = 0; i < flows.size(); i++ ) {
+    const FlowStats & stats = flows[ i ]->stats();
+    const uint64_t running = end - min( start_time( i ), end );
+    const double mbps = running ? stats.datagrams_acked * bits_per_datagram / running : 0;
+    rates.push_back( mbps );
+    total_acked += stats.datagrams_acked;
+
+    cout << "Flow " << i << " (" << flows[ i ]->cc() << "): "
+	 << mbps << " Mbits/s, RTT mean " << stats.rtt.mean() / 1000.0
+	 << " ms, 95th percentile " << stats.rtt.quantile( .95 ) / 1000.0 << " ms, "
+	 << stats.datagrams_sent << " sent, " << stats.datagrams_acked << " acked, "
+	 << stats.datagrams_lost << " lost" << endl;
+  }
+
+  cout << "Aggregate: " << total_acked * bits_per_datagram / duration << " Mbits/s" << endl;
+  cout.precision( 3 );
+  cout << "Jain's fairness index: " << jain_index( rates, flow_weights ) << endl;
+
+  /* fairness over time, once every flow is running: the first full
+     interval from which the index stays at or above 0.9 */
+  const uint64_t interval = options.interval_ms * 1000;
+  const uint64_t last_start = start_time( options.flows - 1 ) - origin;
+  const size_t first = (last_start + interval - 1) / interval;
+  const size_t last = duration / interval; /* exclusive: skip a partial interval */
+
+  size_t converged = last;
+  for ( size_t k = first; k < last; k++ ) {
+    vector<double> interval_rates;
+    for ( const auto & flow : flows ) {
+      const auto & acked = flow->stats().acked_per_interval;
+      interval_rates.push_back( k < acked.size() ? acked[ k ] : 0 );
+    }
+
+    if ( jain_index( interval_rates, flow_weights ) < .9 ) {
+      converged = last;
+    } else if ( converged == last ) {
+      converged = k;
+    }
+  }
+
+  if ( converged < last ) {
+    cout << "Converged (index >= 0.9 in every " << options.interval_ms << " ms interval) "
+	 << (converged * interval - last_start) / 1e6 << " s after the last flow started" << endl;
+  } else {
+    cout << "Did not converge (index >= 0.9 in every " << options.interval_ms
+	 << " ms interval to the end)" << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
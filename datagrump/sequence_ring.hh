@@ -0,0 +1,90 @@
+#ifndef SEQUENCE_RING_HH
+#define SEQUENCE_RING_HH
+
+#include <cstdint>
+#include <vector>
+
+/* Fixed-capacity ring of per-datagram state, indexed by sequence number.
+
+   Sequence numbers are dense and increasing, so seqno modulo a power-of-two
+   capacity is a direct index. Overflow policy: when a new seqno lands on a
+   slot whose previous occupant was never retired, the old entry is evicted
+   (and counted) -- it is just as if its ack never arrived. */
+
+template <typename T>
+class SequenceRing
+{
+private:
+  struct Slot {
+    uint64_t seqno;
+    bool occupied;
+    T value;
+  };
+
+  std::vector<Slot> slots_;
+  uint64_t mask_;
+  uint64_t evictions_;
+
+  static size_t round_up_to_power_of_two( const size_t n )
+  {
+    size_t ret = 1;
+    while ( ret < n ) {
+      ret <<= 1;
+    }
+    return ret;
+  }
+
+  Slot & slot( const uint64_t seqno ) { return slots_[ seqno & mask_ ]; }
+  const Slot & slot( const uint64_t seqno ) const { return slots_[ seqno & mask_ ]; }
+
+public:
+  /* capacity is rounded up to a power of two */
+  SequenceRing( const size_t capacity )
+    : slots_( round_up_to_power_of_two( capacity ), Slot { 0, false, T() } ),
+      mask_( slots_.size() - 1 ),
+      evictions_( 0 )
+  {}
+
+  /* start tracking seqno (evicting whatever was in its slot) */
+  T & insert( const uint64_t seqno )
+  {
+    Slot & s = slot( seqno );
+    if ( s.occupied and s.seqno != seqno ) {
+      evictions_++;
+    }
+
+    s.seqno = seqno;
+    s.occupied = true;
+    s.value = T();
+    return s.value;
+  }
+
+  /* state for seqno, or nullptr if it was never inserted, retired, or evicted */
+  T * find( const uint64_t seqno )
+  {
+    Slot & s = slot( seqno );
+    return (s.occupied and s.seqno == seqno) ? &s.value : nullptr;
+  }
+
+  const T * find( const uint64_t seqno ) const
+  {
+    const Slot & s = slot( seqno );
+    return (s.occupied and s.seqno == seqno) ? &s.value : nullptr;
+  }
+
+  /* stop tracking seqno (no effect if it isn't there) */
+  void erase( const uint64_t seqno )
+  {
+    Slot & s = slot( seqno );
+    if ( s.occupied and s.seqno == seqno ) {
+      s.occupied = false;
+    }
+  }
+
+  size_t capacity( void ) const { return slots_.size(); }
+
+  /* entries dropped because the ring wrapped before they were retired */
+  uint64_t evictions( void ) const { return evictions_; }
+};
+
+#endif
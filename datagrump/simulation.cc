@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "simulation.hh"
+#include "contest_message.hh"
+#include "delayed_acker.hh"
+#include "ack_tracker.hh"
+#include "loss_detector.hh"
+#include "pacer.hh"
+#include "timestamp.hh"
+#include "histogram.hh"
+#include "link.hh"
+
+using namespace std;
+
+/* same datagrams as sender.cc and receiver.cc */
+static const uint64_t datagram_length = ContestMessage::Header::LENGTH + 1424;
+static const uint64_t ack_length = ContestMessage::Header::LENGTH;
+
+/* IPv4 + UDP headers, counted against the link (as in link-emulator) */
+static const uint64_t HEADER_BYTES = 28;
+
+/* nanoseconds per microsecond */
+static const uint64_t THOUSAND_NS = 1000;
+
+/* as in sender.cc */
+static const size_t ACK_TRACKER_CAPACITY = 16384;
+static const size_t LOSS_DETECTOR_CAPACITY = 16384;
+
+/* parse one option, returning false if it isn't recognized */
+bool SimulationOptions::parse( const string & option )
+{
+  const size_t equals = option.find( '=' );
+  const string name = option.substr( 0, equals );
+  const string value = equals == string::npos ? "" : option.substr( equals + 1 );
+
+  try {
+    if ( option == "debug" ) {
+      debug = true;
+    } else if ( option == "pace" ) {
+      pace = true;
+    } else if ( option == "retransmit" ) {
+      retransmit = true;
+    } else if ( value.empty() ) {
+      return false;
+    } else if ( name == "uplink" ) {
+      uplink_trace = value;
+    } else if ( name == "downlink" ) {
+      downlink_trace = value;
+    } else if ( name == "delay" ) {
+      delay_ms = stoull( value );
+    } else if ( name == "queue" ) {
+      queue = value;
+    } else if ( name == "packets" ) {
+      packets = stoull( value );
+    } else if ( name == "bytes" ) {
+      bytes = stoull( value );
+    } else if ( name == "log" ) {
+      log = value;
+    } else if ( name == "duration" ) {
+      duration_s = stod( value );
+      return duration_s > 0;
+    } else if ( name == "cc" ) {
+      cc = value;
+    } else if ( name.compare( 0, 3, "cc." ) == 0 and name.size() > 3 ) {
+      cc_params.set( name.substr( 3 ), value );
+    } else if ( name == "pacing_scale" ) {
+      pacing_scale = stod( value );
+      return pacing_scale > 0;
+    } else if ( name == "burst" ) {
+      burst = stoul( value );
+      return burst > 0;
+    } else if ( name == "ack_every" ) {
+      ack_every = stoul( value );
+      delayed_acks = true;
+      return ack_every > 0;
+    } else if ( name == "ack_delay_ms" ) {
+      ack_delay_ms = stoull( value );
+      delayed_acks = true;
+    } else {
+      return false;
+    }
+  } catch ( const logic_error & ) { /* stod or stoul failed */
+    return false;
+  }
+
+  return true;
+}
+
+string SimulationOptions::to_string( void ) const
+{
+  ostringstream ret;
+
+  ret << "uplink=" << uplink_trace;
+  if ( not downlink_trace.empty() ) {
+    ret << " downlink=" << downlink_trace;
+  }
+  ret << " delay=" << delay_ms;
+  if ( not queue.empty() ) {
+    ret << " queue=" << queue;
+  }
+  if ( packets ) {
+    ret << " packets=" << packets;
+  }
+  if ( bytes ) {
+    ret << " bytes=" << bytes;
+  }
+  ret << " duration=" << duration_s << " cc=" << cc;
+
+  const string params = cc_params.to_string();
+  size_t start = 0;
+  while ( start < params.size() ) {
+    const size_t comma = min( params.find( ',', start ), params.size() );
+    ret << " cc." << params.substr( start, comma - start );
+    start = comma + 1;
+  }
+
+  if ( pace ) {
+    ret << " pace pacing_scale=" << pacing_scale << " burst=" << burst;
+  }
+
+  if ( retransmit ) {
+    ret << " retransmit";
+  }
+
+  if ( delayed_acks ) {
+    ret << " ack_every=" << ack_every << " ack_delay_ms=" << ack_delay_ms;
+  }
+
+  return ret.str();
+}
+
+string SimulationResult::to_string( void ) const
+{
+  ostringstream ret;
+  ret << "Average capacity: " << capacity_mbps << " Mbits/s" << endl
+      << "Average throughput: " << throughput_mbps << " Mbits/s ("
+      << (capacity_mbps > 0 ? 100 * throughput_mbps / capacity_mbps : 0) << "% utilization)" << endl
+      << "Mean per-packet delay: " << mean_delay_ms << " ms" << endl
+      << "95th percentile per-packet delay: " << delay_95th_ms << " ms" << endl
+      << "Power: " << power() << " (Mbits/s per ms)" << endl
+      << "Datagrams: " << datagrams_sent << " sent, " << datagrams_delivered << " delivered, "
+      << datagrams_duplicate << " duplicate, " << datagrams_dropped << " dropped" << endl;
+  return ret.str();
+}
+
+SimulationResult simulate( const SimulationOptions & options )
+{
+  const uint64_t wall_start = monotonic_ns();
+
+  /* the virtual clock, in microseconds since the start of the run */
+  uint64_t now = 0;
+  const uint64_t end = options.duration_s * 1000 * 1000;
+
+  unique_ptr<Controller> controller = make_controller( options.cc, options.debug,
+						       options.cc_params );
+  controller->set_clock( [&now] () { return now; } );
+
+  /* the path */
+  const DeliveryTrace uplink_trace( options.uplink_trace );
+  const uint64_t delay_us = options.delay_ms * 1000;
+  Link uplink( uplink_trace, PacketQueue::make( options.queue, options.packets, options.bytes ),
+	       delay_us, 0 );
+  unique_ptr<Link> downlink( options.downlink_trace.empty()
+			     ? new Link( delay_us, 0 )
+			     : new Link( DeliveryTrace( options.downlink_trace ),
+					 PacketQueue::make( options.queue, options.packets,
+							    options.bytes ),
+					 delay_us, 0 ) );
+
+  ofstream log_file;
+  if ( not options.log.empty() ) {
+    log_file.open( options.log );
+    if ( not log_file.good() ) {
+      throw runtime_error( options.log + ": cannot open log" );
+    }
+    uplink.set_log( log_file, "simulator " + options.to_string() );
+  }
+
+  /* sender state */
+  Pacer pacer( options.pacing_scale, options.burst );
+  uint64_t sequence_number = 0;
+  uint64_t transmissions = 0; /* retransmissions included */
+  uint64_t silence_deadline = controller->timeout_ms() * 1000;
+  AckTracker ack_tracker( ACK_TRACKER_CAPACITY );
+  LossDetector loss_detector( LOSS_DETECTOR_CAPACITY,
+			       options.delayed_acks ? options.ack_delay_ms * 1000 : 0 );
+  deque<uint64_t> retransmissions;
+
+  /* receiver state */
+  DelayedAcker acker( options.ack_every, options.ack_delay_ms * 1000 );
+  LinkPacket newest_received { 0, 0, "", 0, 0, 0, 0, 0 }; /* the datagram a delayed ack echoes */
+  uint64_t ack_deadline = numeric_limits<uint64_t>::max();
+
+  /* what the receiver saw: each datagram's delay (us), and which sequence
+     numbers have arrived (a retransmission may arrive after its original) */
+  Histogram delays;
+  vector<bool> arrived;
+  uint64_t duplicates = 0;
+
+  /* a lost datagram to send again, or a new one */
+  const auto next_datagram = [&] () {
+    while ( not retransmissions.empty() ) {
+      const uint64_t lost = retransmissions.front();
+      retransmissions.pop_front();
+      if ( not ack_tracker.is_acked( lost ) ) {
+	return lost;
+      }
+    }
+
+    return sequence_number++;
+  };
+
+  const auto send_datagram = [&] () {
+    const uint64_t datagram = next_datagram();
+    uplink.send( LinkPacket { datagram, datagram_length + HEADER_BYTES, "", now, 0, 0, 0, 0 }, now );
+    transmissions++;
+    loss_detector.sent( datagram, now );
+    controller->datagram_was_sent( datagram, now, datagram_length );
+  };
+
+  const auto window_is_open = [&] () {
+    return loss_detector.in_flight() < controller->window_size();
+  };
+
+  const auto report_losses = [&] ( const bool timeout ) {
+    const vector<uint64_t> & lost = loss_detector.take_lost();
+    if ( lost.empty() ) {
+      return;
+    }
+
+    for ( const uint64_t datagram : lost ) {
+      if ( options.retransmit ) {
+	retransmissions.push_back( datagram );
+      } else {
+	ack_tracker.give_up( datagram );
+      }
+    }
+
+    controller->datagrams_lost( { now, *max_element( lost.begin(), lost.end() ), lost.size(),
+				  loss_detector.in_flight(), timeout },
+				sequence_number );
+  };
+
+  /* a cumulative ack carries its AckBlock as the packet's contents */
+  const auto send_delayed_ack = [&] () {
+    const ContestMessage::AckBlock block = acker.take_ack_block();
+    string contents( block.length(), 0 );
+    block.serialize( &contents[ 0 ] );
+
+    downlink->send( LinkPacket { newest_received.id, ack_length + block.length() + HEADER_BYTES,
+				 contents, newest_received.send_us, newest_received.recv_us,
+				 0, 0, 0 }, now );
+    ack_deadline = numeric_limits<uint64_t>::max();
+  };
+
+  /* the receiver acks each datagram as it arrives, or delays and combines acks
+     (either way the ack echoes when the newest datagram was sent and arrived,
+     as receiver.cc does, so a retransmission's ack is timed from that copy) */
+  const auto at_receiver = [&] ( LinkPacket && datagram ) {
+    delays.add( now - datagram.arrival_us );
+    datagram.recv_us = now;
+
+    if ( datagram.id >= arrived.size() ) {
+      arrived.resize( datagram.id + 1 );
+    }
+    if ( arrived[ datagram.id ] ) {
+      duplicates++;
+    }
+    arrived[ datagram.id ] = true;
+
+    if ( not options.delayed_acks ) {
+      downlink->send( LinkPacket { datagram.id, ack_length + HEADER_BYTES, "",
+				   datagram.send_us, datagram.recv_us, 0, 0, 0 }, now );
+      return;
+    }
+
+    newest_received = move( datagram );
+    if ( acker.received( newest_received.id ) ) {
+      send_delayed_ack();
+    } else if ( ack_deadline == numeric_limits<uint64_t>::max() ) {
+      ack_deadline = now + acker.delay_us();
+    }
+  };
+
+  const auto at_sender = [&] ( LinkPacket && ack ) {
+    silence_deadline = now + controller->timeout_ms() * 1000;
+
+    const auto no_longer_in_flight = [&] ( const uint64_t datagram ) {
+      loss_detector.acked( datagram, now );
+    };
+    const uint64_t newly_acked = ack.contents.empty()
+      ? ack_tracker.acked( ack.id, no_longer_in_flight )
+      : ack_tracker.acked( ContestMessage::AckBlock( ack.contents.data(), ack.contents.size() ),
+			   no_longer_in_flight );
+    loss_detector.ack_received( max<uint64_t>( now - ack.send_us, 1 ), now );
+
+    controller->ack_received( { ack.id, ack.send_us, ack.recv_us, now,
+				ack_tracker.cumulative_ack(), newly_acked },
+			      sequence_number );
+
+    report_losses( false );
+  };
+
+  while ( now < end ) {
+    /* first rule: if the window is open (and the pacer allows), close it */
+    if ( options.pace ) {
+      while ( pacer.ready( now * THOUSAND_NS ) and window_is_open() ) {
+	unsigned int count = 0;
+	while ( count < pacer.burst() and window_is_open() ) {
+	  send_datagram();
+	  count++;
+	}
+	pacer.released( count, controller->pacing_rate(), now * THOUSAND_NS );
+      }
+    } else {
+      while ( window_is_open() ) {
+	send_datagram();
+      }
+    }
+
+    /* skip ahead to whatever happens next */
+    const uint64_t loss_deadline = loss_detector.deadline();
+    uint64_t next = min( { uplink.next_delivery_us(), downlink->next_delivery_us(),
+			   silence_deadline, ack_deadline, end } );
+    if ( loss_deadline ) {
+      next = min( next, loss_deadline );
+    }
+    if ( options.pace and window_is_open() ) {
+      const uint64_t release_ns = pacer.release_time( now * THOUSAND_NS );
+      next = min( next, (release_ns + THOUSAND_NS - 1) / THOUSAND_NS );
+    }
+    now = max( now, next );
+
+    /* deliver datagrams to the receiver and acks to the sender */
+    uplink.advance_to( now, at_receiver );
+    downlink->advance_to( now, at_sender );
+
+    if ( now >= ack_deadline ) {
+      send_delayed_ack();
+    }
+
+    /* fourth rule: declare datagrams lost or send a tail-loss probe */
+    const LossDetector::Timeout timeout = loss_detector.on_timer( now );
+    if ( timeout == LossDetector::Timeout::Probe ) {
+      send_datagram();
+    }
+    report_losses( timeout == LossDetector::Timeout::RTO );
+
+    /* second rule: after a stretch with no acks, send one datagram */
+    if ( now >= silence_deadline ) {
+      send_datagram();
+      silence_deadline = now + controller->timeout_ms() * 1000;
+    }
+  }
+
+  /* summarize */
+  SimulationResult result;
+  result.datagrams_sent = transmissions;
+  result.datagrams_delivered = delays.count() - duplicates;
+  result.datagrams_duplicate = duplicates;
+  result.datagrams_dropped = uplink.dropped_packets();
+
+  uint64_t opportunities = 0;
+  while ( uplink_trace.opportunity_ms( opportunities ) * 1000 < end ) {
+    opportunities++;
+  }
+
+  const double bits_per_datagram = (datagram_length + HEADER_BYTES) * 8.0;
+  result.capacity_mbps = opportunities * Link::OPPORTUNITY_BYTES * 8.0 / end;
+  result.throughput_mbps = result.datagrams_delivered * bits_per_datagram / end;
+  result.mean_delay_ms = delays.mean() / 1000.0;
+  result.delay_95th_ms = delays.quantile( .95 ) / 1000.0;
+
+  result.wall_seconds = (monotonic_ns() - wall_start) / 1e9;
+
+  return result;
+}
@@ -0,0 +1,69 @@
+#ifndef SIMULATION_HH
+#define SIMULATION_HH
+
+#include <cstdint>
+#include <string>
+
+#include "controller.hh"
+
+/* settings for one simulated run of a controller over an emulated link */
+struct SimulationOptions
+{
+  /* the path (as for link-emulator) */
+  std::string uplink_trace {};
+  std::string downlink_trace {}; /* none means unlimited */
+  uint64_t delay_ms = 20;        /* each way, like run-contest's mm-delay 20 */
+  std::string queue = "";        /* default: infinite, or droptail with a limit */
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  std::string log {};            /* mahimahi-format uplink log */
+
+  /* how long to run, in simulated seconds */
+  double duration_s = 60;
+
+  /* the sender */
+  std::string cc = "bbrish";
+  ControllerParams cc_params {};
+  bool debug = false;
+  bool pace = false;
+  double pacing_scale = 1.0;
+  unsigned int burst = 2;
+  bool retransmit = false;
+
+  /* the receiver (as for receiver's ack_every= and ack_delay_ms=) */
+  bool delayed_acks = false;
+  unsigned int ack_every = 2;
+  uint64_t ack_delay_ms = 25;
+
+  /* parse one NAME=VALUE (or bare word) option, returning false if it isn't recognized */
+  bool parse( const std::string & option );
+
+  /* "name=value ..." for the options that differ from the defaults */
+  std::string to_string( void ) const;
+};
+
+/* how the run went (delays are per datagram, from sending to arrival at the receiver) */
+struct SimulationResult
+{
+  uint64_t datagrams_sent;      /* every transmission, retransmissions included */
+  uint64_t datagrams_delivered; /* distinct sequence numbers that arrived */
+  uint64_t datagrams_duplicate; /* arrivals of a sequence number that had already arrived */
+  uint64_t datagrams_dropped;
+  double capacity_mbps;       /* of the uplink over the run */
+  double throughput_mbps;     /* distinct datagrams delivered to the receiver */
+  double mean_delay_ms;
+  double delay_95th_ms;
+  double wall_seconds;        /* how long the simulation took to run */
+
+  /* throughput / 95th percentile delay, the contest score */
+  double power( void ) const { return delay_95th_ms > 0 ? throughput_mbps / delay_95th_ms : 0; }
+
+  std::string to_string( void ) const;
+};
+
+/* Run the named controller through a datagrump sender and receiver over
+   the emulated link, with a virtual clock instead of sockets and real time
+   (the sender behaves like sender.cc: window, silence timeout, optional pacing) */
+SimulationResult simulate( const SimulationOptions & options );
+
+#endif
@@ -0,0 +1,55 @@
+/* runs a congestion controller over an emulated link in simulated time */
+
+#include <cstdlib>
+#include <iostream>
+
+#include "simulation.hh"
+#include "util.hh"
+
+using namespace std;
+
+int main( int argc, char *argv[] )
+{
+   /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  SimulationOptions options;
+  bool usage_error = argc < 2;
+  if ( not usage_error ) {
+    options.uplink_trace = argv[ 1 ];
+  }
+
+  for ( int i = 2; i < argc; i++ ) {
+    if ( not options.parse( argv[ i ] ) ) {
+      usage_error = true;
+    }
+  }
+
+  if ( usage_error ) {
+    cerr << "Usage: " << argv[ 0 ] << " UPLINK_TRACE [downlink=TRACE] [delay=MS]"
+	 << " [queue=infinite|droptail|drophead] [packets=N] [bytes=N] [log=FILE]"
+	 << " [duration=SECONDS] [cc=NAME] [cc.PARAM=VALUE]... [pace] [pacing_scale=SCALE]"
+	 << " [burst=DATAGRAMS] [retransmit] [ack_every=N] [ack_delay_ms=T] [debug]" << endl;
+    cerr << "(the pace is the controller's pacing rate, including any cc.pacing_gain,"
+	 << " times pacing_scale)" << endl;
+    cerr << "Controllers:";
+    for ( const auto & name : controller_names() ) {
+      cerr << " " << name;
+    }
+    cerr << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const SimulationResult result = simulate( options );
+    cout << options.to_string() << endl << result.to_string();
+    cerr << "Simulated " << options.duration_s << " s in " << result.wall_seconds << " s" << endl;
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+
+#include "sprout_controller.hh"
+
+using namespace std;
+
+/* RTT to assume before the first sample, in microseconds */
+static const uint64_t INITIAL_RTT = 100 * 1000;
+
+/* how long the min one-way delay and min RTT are remembered, in microseconds */
+static const uint64_t MIN_DELAY_WINDOW = 10 * 1000 * 1000;
+
+/* after a long silence, the rate may have walked anywhere; stop counting
+   ticks after this many */
+static const uint64_t MAX_EVOLVE_TICKS = 50;
+
+/* random-walk kernel reaches this many standard deviations either side */
+static const double KERNEL_WIDTH = 4;
+
+/* rates less likely than this are left out of the forecast */
+static const double NEGLIGIBLE = 1e-12;
+
+SproutController::SproutController( const bool debug, const ControllerParams & params )
+  : Controller( debug ),
+    tick_( params.get( "tick_ms", 20 ) * 1000 ),
+    max_rate_( params.get( "max_rate", 8 ) ),
+    volatility_( params.get( "volatility", 1 ) ),
+    confidence_( params.get( "confidence", .95 ) ),
+    target_delay_( params.get( "target_delay_ms", 100 ) * 1000 ),
+    queued_threshold_( params.get( "queued_ms", 5 ) * 1000 ),
+    min_window_( params.get( "min_window", 2 ) ),
+    rates_( max<size_t>( params.get( "bins", 256 ), 2 ) ),
+    diffusion_(),
+    evolved_( rates_.size() ),
+    likelihood_( rates_.size() ),
+    started_( false ),
+    interval_start_( 0 ),
+    interval_arrivals_( 0 ),
+    interval_queued_( false ),
+    min_delay_( MIN_DELAY_WINDOW ),
+    min_rtt_( MIN_DELAY_WINDOW ),
+    window_( params.get( "initial_window", 10 ) ),
+    pacing_rate_( window_ / (INITIAL_RTT / 1000.0) )
+{
+  /* nothing known yet: every rate on the grid equally likely */
+  fill( rates_.begin(), rates_.end(), 1.0 / rates_.size() );
+
+  /* the rate's random walk over one tick, discretized to the grid */
+  const double stddev = volatility_ * sqrt( tick_ / 1e6 ) / bin_width();
+  const int half_width = ceil( KERNEL_WIDTH * stddev );
+  double total = 0;
+  for ( int offset = -half_width; offset <= half_width; offset++ ) {
+    const double weight = stddev > 0 ? exp( -.5 * pow( offset / stddev, 2 ) ) : 1;
+    diffusion_.push_back( weight );
+    total += weight;
+  }
+  for ( auto & weight : diffusion_ ) {
+    weight /= total;
+  }
+}
+
+unsigned int SproutController::window_size( void )
+{
+  return window_;
+}
+
+/* let a tick go by: spread each rate's probability over where it may have walked */
+void SproutController::evolve( void )
+{
+  const int bins = rates_.size();
+  const int half_width = diffusion_.size() / 2;
+  fill( evolved_.begin(), evolved_.end(), 0 );
+
+  for ( int from = 0; from < bins; from++ ) {
+    if ( rates_[ from ] < NEGLIGIBLE ) {
+      continue;
+    }
+    for ( int offset = -half_width; offset <= half_width; offset++ ) {
+      /* the walk doesn't leave the grid */
+      const int to = min( max( from + offset, 0 ), bins - 1 );
+      evolved_[ to ] += rates_[ from ] * diffusion_[ offset + half_width ];
+    }
+  }
+
+  rates_.swap( evolved_ );
+}
+
+/* Bayes' rule, given the datagrams that arrived over an interval
+   (or, if the link may have idled, that it could carry at least that many) */
+void SproutController::observe( const uint64_t arrivals, const double interval_ms,
+				const bool lower_bound )
+{
+  if ( lower_bound ) {
+    /* P(N >= arrivals), normal approximation to the Poisson */
+    for ( size_t bin = 0; bin < rates_.size(); bin++ ) {
+      const double mean = rate( bin ) * interval_ms;
+      likelihood_[ bin ] = arrivals == 0 ? 1
+	: .5 * erfc( (arrivals - .5 - mean) / sqrt( 2 * mean ) );
+    }
+  } else {
+    /* P(N = arrivals), in logs (the arrivals! is common to every rate) */
+    double most_likely = -HUGE_VAL;
+    for ( size_t bin = 0; bin < rates_.size(); bin++ ) {
+      const double mean = rate( bin ) * interval_ms;
+      likelihood_[ bin ] = arrivals * log( mean ) - mean;
+      most_likely = max( most_likely, likelihood_[ bin ] );
+    }
+    for ( auto & l : likelihood_ ) {
+      l = exp( l - most_likely );
+    }
+  }
+
+  double total = 0;
+  for ( size_t bin = 0; bin < rates_.size(); bin++ ) {
+    total += rates_[ bin ] * likelihood_[ bin ];
+  }
+
+  /* an observation no rate on the grid can explain tells us nothing */
+  if ( total <= 0 ) {
+    return;
+  }
+
+  for ( size_t bin = 0; bin < rates_.size(); bin++ ) {
+    rates_[ bin ] *= likelihood_[ bin ] / total;
+  }
+}
+
+/* the most datagrams the link delivers over the horizon with probability at
+   least confidence_ (normal approximation to the count at each rate, widened
+   by the rate's random walk over the horizon) */
+double SproutController::forecast( const double horizon_ms ) const
+{
+  const double walk_variance = pow( volatility_, 2 ) * pow( horizon_ms, 3 ) / 3000;
+
+  const auto at_least = [&] ( const double count ) {
+    double probability = 0;
+    for ( size_t bin = 0; bin < rates_.size(); bin++ ) {
+      if ( rates_[ bin ] < NEGLIGIBLE ) {
+	continue;
+      }
+      const double mean = rate( bin ) * horizon_ms;
+      const double variance = mean + walk_variance;
+      probability += rates_[ bin ] * .5 * erfc( (count - mean) / sqrt( 2 * variance ) );
+    }
+    return probability;
+  };
+
+  /* bisect between nothing and the fastest rate's count */
+  double low = 0, high = max_rate_ * horizon_ms;
+  while ( high - low > .5 ) {
+    const double middle = (low + high) / 2;
+    if ( at_least( middle ) >= confidence_ ) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+/* send only what the link will (confidently) deliver before a datagram
+   sent now has waited target_delay_ in the queue */
+void SproutController::update_window( void )
+{
+  const double min_rtt_ms = (min_rtt_.empty() ? INITIAL_RTT : min_rtt_.best()) / 1000.0;
+
+  window_ = max( min_window_, forecast( min_rtt_ms + target_delay_ / 1000.0 ) );
+  pacing_rate_ = window_ / min_rtt_ms;
+}
+
+void SproutController::ack_received( const AckEvent & ack,
+				     const uint64_t next_sequence_number )
+{
+  const uint64_t now = ack.timestamp_ack_received;
+  min_rtt_.update( max<uint64_t>( now - ack.send_timestamp_acked, 1 ), now );
+
+  /* did the datagram wait in a queue? (the clocks' offset cancels) */
+  const int64_t delay = int64_t( ack.recv_timestamp_acked ) - int64_t( ack.send_timestamp_acked );
+  min_delay_.update( delay, now );
+  const bool queued = delay - min_delay_.best() >= queued_threshold_;
+
+  /* the ack covers the datagrams that arrived since the previous one */
+  const uint64_t arrival = ack.recv_timestamp_acked;
+  if ( not started_ ) {
+    started_ = true;
+    interval_start_ = arrival;
+  }
+
+  interval_arrivals_ += ack.datagrams_acked;
+  interval_queued_ = interval_queued_ or queued;
+
+  /* once at least a tick has gone by (delayed acks may stretch it), observe it */
+  if ( arrival >= interval_start_ + tick_ ) {
+    const uint64_t interval = arrival - interval_start_;
+
+    for ( uint64_t i = 0; i < min( interval / tick_, MAX_EVOLVE_TICKS ); i++ ) {
+      evolve();
+    }
+    observe( interval_arrivals_, interval / 1000.0, not interval_queued_ );
+
+    interval_start_ = arrival;
+    interval_arrivals_ = 0;
+    interval_queued_ = false;
+    update_window();
+  }
+
+  Controller::ack_received( ack, next_sequence_number );
+}
+
+double SproutController::pacing_rate( void )
+{
+  return pacing_rate_;
+}
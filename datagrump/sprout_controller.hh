@@ -0,0 +1,77 @@
+#ifndef SPROUT_CONTROLLER_HH
+#define SPROUT_CONTROLLER_HH
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "controller.hh"
+#include "windowed_filter.hh"
+
+/* Sprout (Winstein, Sivaraman and Balakrishnan, NSDI 2013): treat the
+   link's delivery rate as a random walk, and the datagrams that reach
+   the receiver as Poisson at that rate. A Bayesian filter over a grid
+   of rates is updated about once a tick from the arrivals at the
+   receiver (timed by the receiver's clock, so ack delay doesn't blur
+   them). It forecasts how many datagrams the link will deliver over
+   the next min RTT + target_delay, and the window is the count it is
+   confident (at the chosen confidence) of delivering.
+
+   An interval in which nothing queued only shows that the link could
+   carry at least what arrived, so it counts as a lower bound rather
+   than an observation of the rate. */
+
+class SproutController : public Controller
+{
+private:
+  /* Tunable parameters */
+  uint64_t tick_;               /* us */
+  double max_rate_;             /* datagrams/ms, top of the grid */
+  double volatility_;           /* datagrams/ms per sqrt(s) */
+  double confidence_;
+  uint64_t target_delay_;       /* us */
+  int64_t queued_threshold_;    /* us of one-way queueing that means the link was busy */
+  double min_window_;           /* datagrams */
+
+  /* probability of each rate (bin i is rate (i + 1/2) x bin width) */
+  std::vector<double> rates_;
+  std::vector<double> diffusion_; /* random-walk kernel for one tick, centered */
+
+  /* scratch space for evolve() and observe(), one entry per bin */
+  std::vector<double> evolved_;
+  std::vector<double> likelihood_;
+
+  /* arrivals since the last observation, by the receiver's clock */
+  bool started_;
+  uint64_t interval_start_;
+  uint64_t interval_arrivals_;
+  bool interval_queued_;
+
+  /* one-way delay (offset by the difference between the clocks) */
+  WindowedFilter<int64_t, uint64_t, std::less<int64_t>> min_delay_;
+  WindowedFilter<uint64_t, uint64_t, std::less<uint64_t>> min_rtt_;
+
+  double window_;               /* datagrams */
+  double pacing_rate_;          /* datagrams/ms */
+
+  double bin_width( void ) const { return max_rate_ / rates_.size(); }
+  double rate( const size_t bin ) const { return (bin + .5) * bin_width(); }
+
+  void evolve( void );
+  void observe( const uint64_t arrivals, const double interval_ms,
+		const bool lower_bound );
+  double forecast( const double horizon_ms ) const;
+  void update_window( void );
+
+public:
+  SproutController( const bool debug, const ControllerParams & params );
+
+  unsigned int window_size( void ) override;
+
+  void ack_received( const AckEvent & ack,
+		     const uint64_t next_sequence_number ) override;
+
+  double pacing_rate( void ) override;
+};
+
+#endif
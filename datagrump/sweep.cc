@@ -0,0 +1,239 @@
+/* runs the simulator over a grid of traces and parameters, in parallel,
+   and tabulates throughput, delay and power for each configuration */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "simulation.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* one axis of the grid: an option name and the values to try */
+struct Dimension
+{
+  string name;
+  vector<string> values;
+};
+
+/* one configuration and how it went */
+struct Run
+{
+  SimulationOptions options;
+  vector<string> values; /* of each dimension */
+  SimulationResult result;
+  string error;
+};
+
+/* "name=a,b,c" -> { name, { a, b, c } } (bare words are a dimension of one) */
+static Dimension parse_dimension( const string & argument )
+{
+  const size_t equals = argument.find( '=' );
+  if ( equals == string::npos ) {
+    return { argument, { "" } };
+  }
+
+  Dimension ret { argument.substr( 0, equals ), {} };
+  const string values = argument.substr( equals + 1 );
+  size_t start = 0;
+  while ( start <= values.size() ) {
+    const size_t comma = min( values.find( ',', start ), values.size() );
+    ret.values.push_back( values.substr( start, comma - start ) );
+    start = comma + 1;
+  }
+  return ret;
+}
+
+/* every combination of one value from each dimension */
+static vector<Run> expand_grid( const vector<Dimension> & dimensions )
+{
+  vector<Run> runs;
+  vector<size_t> choice( dimensions.size(), 0 );
+
+  while ( true ) {
+    Run run { SimulationOptions(), {}, SimulationResult(), "" };
+    for ( size_t i = 0; i < dimensions.size(); i++ ) {
+      const Dimension & dimension = dimensions[ i ];
+      const string & value = dimension.values[ choice[ i ] ];
+      const string option = value.empty() ? dimension.name : dimension.name + "=" + value;
+      if ( not run.options.parse( option ) ) {
+	throw runtime_error( "bad option " + option );
+      }
+      run.values.push_back( value );
+    }
+    runs.push_back( run );
+
+    /* next combination, like an odometer */
+    size_t i = dimensions.size();
+    while ( i > 0 and ++choice[ i - 1 ] == dimensions[ i - 1 ].values.size() ) {
+      choice[ i - 1 ] = 0;
+      i--;
+    }
+    if ( i == 0 ) {
+      return runs;
+    }
+  }
+}
+
+/* run every configuration, each worker taking the next one not yet started */
+static void run_all( vector<Run> & runs, const unsigned int jobs )
+{
+  atomic<size_t> next_run( 0 );
+  size_t finished = 0;
+  mutex progress_mutex;
+
+  const auto worker = [&] () {
+    for ( size_t i = next_run++; i < runs.size(); i = next_run++ ) {
+      try {
+	runs[ i ].result = simulate( runs[ i ].options );
+      } catch ( const exception & e ) {
+	runs[ i ].error = e.what();
+      }
+      lock_guard<mutex> lock( progress_mutex );
+      cerr << "\r" << ++finished << "/" << runs.size() << " runs done" << flush;
+    }
+  };
+
+  vector<thread> threads;
+  for ( unsigned int i = 0; i < jobs; i++ ) {
+    threads.emplace_back( worker );
+  }
+  for ( auto & thread : threads ) {
+    thread.join();
+  }
+  cerr << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+   /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  unsigned int jobs = max( 1u, thread::hardware_concurrency() );
+  bool csv = false;
+  vector<Dimension> dimensions;
+  bool have_uplink = false;
+
+  try {
+    for ( int i = 1; i < argc; i++ ) {
+      const string argument = argv[ i ];
+      if ( argument.compare( 0, 5, "jobs=" ) == 0 ) {
+	jobs = stoul( argument.substr( 5 ) );
+      } else if ( argument == "format=csv" ) {
+	csv = true;
+      } else if ( argument == "format=text" ) {
+	csv = false;
+      } else if ( argument.compare( 0, 4, "log=" ) == 0 or argument == "debug" ) {
+	throw runtime_error( argument + " doesn't make sense for a sweep" );
+      } else {
+	dimensions.push_back( parse_dimension( argument ) );
+	have_uplink = have_uplink or dimensions.back().name == "uplink";
+      }
+    }
+
+    if ( not have_uplink or jobs == 0 ) {
+      throw runtime_error( "need uplink=TRACE[,TRACE...] and at least one job" );
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    cerr << "Usage: " << argv[ 0 ] << " uplink=TRACE[,TRACE...] [OPTION=VALUE[,VALUE...]]..."
+	 << " [jobs=N] [format=text|csv]" << endl
+	 << "(options are the simulator's, e.g. cc=bbrish,copa cc.gain=1.25,1.5,2"
+	 << " delay=20 packets=100 duration=60)" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    vector<Run> runs = expand_grid( dimensions );
+    jobs = min<size_t>( jobs, runs.size() );
+    cerr << "Running " << runs.size() << " simulations on " << jobs << " threads" << endl;
+    run_all( runs, jobs );
+
+    /* only the dimensions with more than one value get a column */
+    vector<size_t> columns;
+    for ( size_t i = 0; i < dimensions.size(); i++ ) {
+      if ( dimensions[ i ].values.size() > 1 or dimensions[ i ].name == "uplink" ) {
+	columns.push_back( i );
+      }
+    }
+
+    const vector<string> metrics = { "throughput_mbps", "utilization", "delay_95th_ms",
+				     "mean_delay_ms", "power", "dropped" };
+    const int width = 16;
+
+    /* header */
+    for ( const auto i : columns ) {
+      if ( csv ) {
+	cout << dimensions[ i ].name << ",";
+      } else {
+	cout << left << setw( max<int>( width, dimensions[ i ].name.size() + 2 ) )
+	     << dimensions[ i ].name;
+      }
+    }
+    for ( size_t m = 0; m < metrics.size(); m++ ) {
+      if ( csv ) {
+	cout << metrics[ m ] << (m + 1 < metrics.size() ? "," : "");
+      } else {
+	cout << right << setw( width ) << metrics[ m ];
+      }
+    }
+    cout << endl;
+
+    /* one row per run */
+    size_t best = runs.size();
+    for ( size_t r = 0; r < runs.size(); r++ ) {
+      const Run & run = runs[ r ];
+      for ( const auto i : columns ) {
+	if ( csv ) {
+	  cout << run.values[ i ] << ",";
+	} else {
+	  cout << left << setw( max<int>( width, dimensions[ i ].name.size() + 2 ) )
+	       << run.values[ i ];
+	}
+      }
+
+      if ( not run.error.empty() ) {
+	cout << (csv ? "" : "  ") << "error: " << run.error << endl;
+	continue;
+      }
+
+      const SimulationResult & result = run.result;
+      const double utilization = result.capacity_mbps > 0
+	? result.throughput_mbps / result.capacity_mbps : 0;
+      const vector<double> values = { result.throughput_mbps, utilization, result.delay_95th_ms,
+				      result.mean_delay_ms, result.power(),
+				      double( result.datagrams_dropped ) };
+      for ( size_t m = 0; m < values.size(); m++ ) {
+	if ( csv ) {
+	  cout << values[ m ] << (m + 1 < values.size() ? "," : "");
+	} else {
+	  cout << right << setw( width ) << values[ m ];
+	}
+      }
+      cout << endl;
+
+      if ( best == runs.size() or result.power() > runs[ best ].result.power() ) {
+	best = r;
+      }
+    }
+
+    if ( best < runs.size() ) {
+      cerr << "Best power: " << runs[ best ].result.power() << " with "
+	   << runs[ best ].options.to_string() << endl;
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <limits>
+
+#include "vegas_controller.hh"
+
+using namespace std;
+
+/* RTT to assume before the first sample, in microseconds */
+static const uint64_t INITIAL_RTT = 100 * 1000;
+
+VegasController::VegasController( const bool debug, const ControllerParams & params )
+  : Controller( debug ),
+    alpha_( params.get( "alpha", 2 ) ),
+    beta_( params.get( "beta", 4 ) ),
+    gamma_( params.get( "gamma", 1 ) ),
+    min_window_( params.get( "min_window", 2 ) ),
+    rtt_(),
+    window_( params.get( "initial_window", 10 ) ),
+    slow_start_( true ),
+    grow_this_round_( true ),
+    round_end_( 0 ),
+    round_min_rtt_( numeric_limits<uint64_t>::max() )
+{}
+
+unsigned int VegasController::window_size( void )
+{
+  return window_;
+}
+
+/* adjust the window using the smallest RTT seen in the round that just ended */
+void VegasController::end_round( const uint64_t next_sequence_number )
+{
+  const double base_rtt = rtt_.min( INITIAL_RTT );
+  const double queued = window_ * (1 - base_rtt / round_min_rtt_);
+
+  if ( slow_start_ ) {
+    if ( queued > gamma_ ) {
+      slow_start_ = false;
+      window_ = max( window_ * base_rtt / round_min_rtt_ + 1, min_window_ );
+    } else if ( grow_this_round_ ) {
+      window_ *= 2;
+    }
+    grow_this_round_ = not grow_this_round_;
+  } else if ( queued < alpha_ ) {
+    window_ += 1;
+  } else if ( queued > beta_ ) {
+    window_ = max( window_ - 1, min_window_ );
+  }
+
+  round_end_ = next_sequence_number;
+  round_min_rtt_ = numeric_limits<uint64_t>::max();
+}
+
+void VegasController::ack_received( const AckEvent & ack,
+				    const uint64_t next_sequence_number )
+{
+  const uint64_t rtt = max<uint64_t>( ack.timestamp_ack_received - ack.send_timestamp_acked, 1 );
+  rtt_.update( rtt );
+  round_min_rtt_ = min( round_min_rtt_, rtt );
+
+  if ( ack.sequence_number_acked >= round_end_ ) {
+    end_round( next_sequence_number );
+  }
+
+  Controller::ack_received( ack, next_sequence_number );
+}
+
+/* one window per smoothed RTT */
+double VegasController::pacing_rate( void )
+{
+  return window_ / (rtt_.smoothed( INITIAL_RTT ) / 1000.0);
+}
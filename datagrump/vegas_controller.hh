@@ -0,0 +1,45 @@
+#ifndef VEGAS_CONTROLLER_HH
+#define VEGAS_CONTROLLER_HH
+
+#include <cstdint>
+
+#include "controller.hh"
+#include "rtt_estimator.hh"
+
+/* TCP Vegas: once per RTT, estimate how many of our datagrams are
+   sitting in queues (window x (1 - base RTT / RTT)) and nudge the
+   window to keep that between alpha and beta. Slow start doubles
+   the window every other RTT until the queue passes gamma. */
+
+class VegasController : public Controller
+{
+private:
+  /* Tunable parameters */
+  double alpha_;        /* datagrams queued */
+  double beta_;         /* datagrams queued */
+  double gamma_;        /* datagrams queued */
+  double min_window_;   /* datagrams */
+
+  RTTEstimator rtt_;
+  double window_;       /* datagrams */
+  bool slow_start_;
+  bool grow_this_round_;
+
+  /* the round ends when this datagram is acked */
+  uint64_t round_end_;
+  uint64_t round_min_rtt_;  /* us */
+
+  void end_round( const uint64_t next_sequence_number );
+
+public:
+  VegasController( const bool debug, const ControllerParams & params );
+
+  unsigned int window_size( void ) override;
+
+  void ack_received( const AckEvent & ack,
+		     const uint64_t next_sequence_number ) override;
+
+  double pacing_rate( void ) override;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef WINDOWED_FILTER_HH
+#define WINDOWED_FILTER_HH
+
+#include <functional>
+
+/* Running best (max, by default, or min) of the samples seen over a
+   sliding window, in constant time and space: Kathleen Nichols's
+   algorithm, as used by BBR (and Linux's lib/minmax.c).
+
+   Instead of every sample, the filter keeps the best, second-best and
+   third-best of successive quarters/halves of the window, so when the
+   best ages out its successor is already at hand. The answer is exact
+   while the best is fresh and at worst a sample or two behind after it
+   expires.
+
+   The window is measured in whatever Key is: microseconds for a
+   time-based window, or a round (or sequence-number) count for a
+   round-based one. Keys should not go backwards. */
+
+template <typename T, typename Key, typename Compare = std::greater<T>>
+class WindowedFilter
+{
+private:
+  struct Sample {
+    T value;
+    Key key;
+  };
+
+  Key window_;
+  Compare better_;
+  Sample estimates_[ 3 ]; /* best, second best, third best */
+  bool empty_;
+
+  /* how far key is past an earlier one (0 if it isn't) */
+  static Key age( const Key key, const Key earlier )
+  {
+    return key > earlier ? key - earlier : Key();
+  }
+
+  void reset( const T & value, const Key key )
+  {
+    estimates_[ 0 ] = estimates_[ 1 ] = estimates_[ 2 ] = Sample { value, key };
+    empty_ = false;
+  }
+
+public:
+  WindowedFilter( const Key window )
+    : window_( window ), better_(), estimates_(), empty_( true )
+  {}
+
+  /* add a sample, taken at key */
+  void update( const T & value, const Key key )
+  {
+    if ( empty_
+	 or not better_( estimates_[ 0 ].value, value )
+	 or age( key, estimates_[ 2 ].key ) > window_ ) {
+      /* a new best, or nothing in the window is worth keeping */
+      reset( value, key );
+      return;
+    }
+
+    const Sample sample { value, key };
+    if ( not better_( estimates_[ 1 ].value, value ) ) {
+      estimates_[ 1 ] = estimates_[ 2 ] = sample;
+    } else if ( not better_( estimates_[ 2 ].value, value ) ) {
+      estimates_[ 2 ] = sample;
+    }
+
+    /* age the estimates, keeping them spread across the window */
+    const Key best_age = age( key, estimates_[ 0 ].key );
+    if ( best_age > window_ ) {
+      estimates_[ 0 ] = estimates_[ 1 ];
+      estimates_[ 1 ] = estimates_[ 2 ];
+      estimates_[ 2 ] = sample;
+      if ( age( key, estimates_[ 0 ].key ) > window_ ) {
+	estimates_[ 0 ] = estimates_[ 1 ];
+	estimates_[ 1 ] = estimates_[ 2 ];
+      }
+    } else if ( estimates_[ 1 ].key == estimates_[ 0 ].key and best_age > window_ / 4 ) {
+      /* a quarter of the window went by without a second best */
+      estimates_[ 1 ] = estimates_[ 2 ] = sample;
+    } else if ( estimates_[ 2 ].key == estimates_[ 1 ].key and best_age > window_ / 2 ) {
+      /* half the window went by without a third best */
+      estimates_[ 2 ] = sample;
+    }
+  }
+
+  /* forget whatever has left the window as of key, without adding a sample
+     (for windows that can run out before the next sample comes) */
+  void expire( const Key key )
+  {
+    while ( not empty_ and age( key, estimates_[ 0 ].key ) > window_ ) {
+      if ( estimates_[ 0 ].key == estimates_[ 2 ].key ) {
+	empty_ = true;
+      } else {
+	estimates_[ 0 ] = estimates_[ 1 ];
+	estimates_[ 1 ] = estimates_[ 2 ];
+      }
+    }
+  }
+
+  void clear( void ) { empty_ = true; }
+
+  bool empty( void ) const { return empty_; }
+
+  /* the best sample in the window (only meaningful if not empty) */
+  const T & best( void ) const { return estimates_[ 0 ].value; }
+  Key best_key( void ) const { return estimates_[ 0 ].key; }
+
+  Key window( void ) const { return window_; }
+  void set_window( const Key window ) { window_ = window; }
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include <fstream>
+#include <stdexcept>
+
+#include "delivery_trace.hh"
+
+using namespace std;
+
+DeliveryTrace::DeliveryTrace( const string & filename )
+  : name_( filename ), schedule_()
+{
+  ifstream trace_file( filename );
+  if ( not trace_file.good() ) {
+    throw runtime_error( filename + ": cannot open trace" );
+  }
+
+  string line;
+  unsigned int line_number = 0;
+  while ( getline( trace_file, line ) ) {
+    line_number++;
+    if ( line.empty() ) {
+      continue;
+    }
+
+    size_t parsed = 0;
+    uint64_t ms = 0;
+    try {
+      ms = stoull( line, &parsed );
+    } catch ( const logic_error & ) {
+      parsed = 0;
+    }
+
+    if ( parsed == 0 or line.find_first_not_of( " \t\r", parsed ) != string::npos ) {
+      throw runtime_error( filename + ":" + to_string( line_number )
+			   + ": expected a timestamp in milliseconds" );
+    }
+
+    if ( not schedule_.empty() and ms < schedule_.back() ) {
+      throw runtime_error( filename + ":" + to_string( line_number )
+			   + ": timestamps must not decrease" );
+    }
+
+    schedule_.push_back( ms );
+  }
+
+  if ( schedule_.empty() or schedule_.back() == 0 ) {
+    throw runtime_error( filename + ": trace must last at least one millisecond" );
+  }
+}
+
+DeliveryTrace::DeliveryTrace( const string & name, const vector<uint64_t> & schedule )
+  : name_( name ), schedule_( schedule )
+{
+  for ( size_t i = 1; i < schedule_.size(); i++ ) {
+    if ( schedule_[ i ] < schedule_[ i - 1 ] ) {
+      throw runtime_error( name + ": timestamps must not decrease" );
+    }
+  }
+
+  if ( schedule_.empty() or schedule_.back() == 0 ) {
+    throw runtime_error( name + ": trace must last at least one millisecond" );
+  }
+}
+
+DeliveryTrace DeliveryTrace::constant_rate( const unsigned int opportunities_per_ms )
+{
+  if ( opportunities_per_ms == 0 ) {
+    throw runtime_error( "constant-rate trace needs at least one opportunity per millisecond" );
+  }
+
+  return DeliveryTrace( "constant " + to_string( opportunities_per_ms ) + "/ms",
+			vector<uint64_t>( opportunities_per_ms, 1 ) );
+}
+
+/* the trace repeats, shifted by its period each time */
+uint64_t DeliveryTrace::opportunity_ms( const uint64_t index ) const
+{
+  return schedule_[ index % schedule_.size() ] + (index / schedule_.size()) * period_ms();
+}
@@ -0,0 +1,38 @@
+#ifndef DELIVERY_TRACE_HH
+#define DELIVERY_TRACE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* mahimahi-format packet-delivery trace: one line per delivery
+   opportunity (room for one MTU-sized packet), giving its time in
+   milliseconds. The trace repeats once it runs out. */
+
+class DeliveryTrace
+{
+private:
+  std::string name_;
+  std::vector<uint64_t> schedule_; /* ms, nondecreasing */
+
+public:
+  /* read a trace file */
+  DeliveryTrace( const std::string & filename );
+
+  /* a trace from an explicit schedule */
+  DeliveryTrace( const std::string & name, const std::vector<uint64_t> & schedule );
+
+  /* a link with a fixed number of opportunities per millisecond */
+  static DeliveryTrace constant_rate( const unsigned int opportunities_per_ms );
+
+  const std::string & name( void ) const { return name_; }
+
+  /* opportunities in one pass through the trace, and how long the pass takes */
+  uint64_t size( void ) const { return schedule_.size(); }
+  uint64_t period_ms( void ) const { return schedule_.back(); }
+
+  /* time of the index'th opportunity, in milliseconds from the start of the trace */
+  uint64_t opportunity_ms( const uint64_t index ) const;
+};
+
+#endif
@@ -0,0 +1,247 @@
+/* UDP link emulator: forwards datagrams from senders to a receiver
+   across an emulated bottleneck (and the acks back), with no mahimahi needed */
+
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+
+#include <csignal>
+#include <sys/signalfd.h>
+
+#include "socket.hh"
+#include "poller.hh"
+#include "timestamp.hh"
+#include "util.hh"
+#include "link.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* IPv4 + UDP headers, counted against the link like mahimahi does */
+static const uint64_t HEADER_BYTES = 28;
+
+/* nanoseconds per microsecond */
+static const uint64_t THOUSAND_NS = 1000;
+
+/* how often to wake up when nothing is crossing the links */
+static const uint64_t IDLE_NS = 1000 * 1000 * 1000;
+
+/* settings from the command line */
+struct EmulatorOptions
+{
+  string uplink_trace {};
+  string downlink_trace {}; /* none means unlimited */
+  uint64_t delay_ms = 0;    /* each way */
+  string queue = "";
+  uint64_t packets = 0;
+  uint64_t bytes = 0;
+  string log {};
+
+  /* parse one option, returning false if it isn't recognized */
+  bool parse( const string & option );
+};
+
+bool EmulatorOptions::parse( const string & option )
+{
+  const size_t equals = option.find( '=' );
+  if ( equals == string::npos or equals + 1 == option.size() ) {
+    return false;
+  }
+
+  const string name = option.substr( 0, equals );
+  const string value = option.substr( equals + 1 );
+
+  try {
+    if ( name == "downlink" ) {
+      downlink_trace = value;
+    } else if ( name == "delay" ) {
+      delay_ms = stoull( value );
+    } else if ( name == "queue" ) {
+      queue = value;
+    } else if ( name == "packets" ) {
+      packets = stoull( value );
+    } else if ( name == "bytes" ) {
+      bytes = stoull( value );
+    } else if ( name == "log" ) {
+      log = value;
+    } else {
+      return false;
+    }
+  } catch ( const logic_error & ) { /* stoull failed */
+    return false;
+  }
+
+  return true;
+}
+
+int main( int argc, char *argv[] )
+{
+   /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  EmulatorOptions options;
+  bool usage_error = argc < 5;
+  for ( int i = 5; i < argc; i++ ) {
+    if ( not options.parse( argv[ i ] ) ) {
+      usage_error = true;
+    }
+  }
+
+  if ( usage_error ) {
+    cerr << "Usage: " << argv[ 0 ] << " PORT RECEIVER_HOST RECEIVER_PORT UPLINK_TRACE"
+	 << " [downlink=TRACE] [delay=MS] [queue=infinite|droptail|drophead]"
+	 << " [packets=N] [bytes=N] [log=FILE]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const uint64_t start = timestamp_us();
+    const uint64_t delay_us = options.delay_ms * 1000;
+
+    /* datagrump sender -> uplink -> receiver, and the acks back on the downlink */
+    Link uplink( DeliveryTrace( argv[ 4 ] ),
+		 PacketQueue::make( options.queue, options.packets, options.bytes ),
+		 delay_us, start );
+    unique_ptr<Link> downlink( options.downlink_trace.empty()
+			       ? new Link( delay_us, start )
+			       : new Link( DeliveryTrace( options.downlink_trace ),
+					   PacketQueue::make( options.queue, options.packets, options.bytes ),
+					   delay_us, start ) );
+
+    ofstream log_file;
+    if ( not options.log.empty() ) {
+      log_file.open( options.log );
+      if ( not log_file.good() ) {
+	throw runtime_error( options.log + ": cannot open log" );
+      }
+
+      string command_line;
+      for ( int i = 0; i < argc; i++ ) {
+	command_line += string( i ? " " : "" ) + argv[ i ];
+      }
+      uplink.set_log( log_file, command_line );
+    }
+
+    /* exit cleanly (so the log is complete) when interrupted */
+    sigset_t signals;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGINT );
+    sigaddset( &signals, SIGTERM );
+    SystemCall( "sigprocmask", sigprocmask( SIG_BLOCK, &signals, nullptr ) );
+    FileDescriptor signal_fd( SystemCall( "signalfd", signalfd( -1, &signals, SFD_CLOEXEC ) ) );
+
+    /* the senders talk to this socket as if it were the receiver */
+    UDPSocket sender_side;
+    sender_side.bind( Address( "::0", argv[ 1 ] ) );
+
+    const Address receiver_address( argv[ 2 ], argv[ 3 ] );
+
+    cerr << "Listening on " << sender_side.local_address().to_string()
+	 << ", forwarding to " << receiver_address.to_string() << endl;
+
+    /* Each sender gets its own socket toward the receiver (like a NAT),
+       so the receiver can tell the flows apart and each one's acks find
+       their way back. A packet's id on either link is its flow's index. */
+    struct Flow
+    {
+      Address sender;
+      UDPSocket receiver_side;
+    };
+    deque<Flow> flows; /* (a deque, so the poller's references stay put) */
+    map<string, size_t> flow_index; /* by sender address */
+    size_t flows_registered = 0;
+
+    const auto to_receiver = [&] ( LinkPacket && packet ) {
+      flows.at( packet.id ).receiver_side.send( packet.contents );
+    };
+
+    const auto to_sender = [&] ( LinkPacket && packet ) {
+      sender_side.sendto( flows.at( packet.id ).sender, packet.contents );
+    };
+
+    /* deliver whatever has crossed either link by now */
+    const auto advance_links = [&] ( const uint64_t now ) {
+      uplink.advance_to( now, to_receiver );
+      downlink->advance_to( now, to_sender );
+    };
+
+    UDPSocket::RecvBatch batch;
+    Poller poller;
+
+    /* first rule: datagrams from the senders enter the uplink */
+    poller.add_action( Action( sender_side, Direction::In, [&] () {
+	  sender_side.recv_batch( batch );
+	  const uint64_t now = timestamp_us();
+	  advance_links( now );
+	  for ( const auto & recd : batch ) {
+	    auto flow = flow_index.find( recd.source_address.to_string() );
+	    if ( flow == flow_index.end() ) {
+	      flows.push_back( Flow { recd.source_address, UDPSocket() } );
+	      flows.back().receiver_side.connect( receiver_address );
+	      flow = flow_index.emplace( recd.source_address.to_string(), flows.size() - 1 ).first;
+	    }
+
+	    uplink.send( LinkPacket { flow->second, recd.length + HEADER_BYTES,
+				      string( recd.payload, recd.length ), 0, 0, 0, 0, 0 }, now );
+	  }
+	  return ResultType::Continue;
+	} ) );
+
+    /* second rule: acks from the receiver enter the downlink
+       (registered for each new flow between polls) */
+    const auto listen_for_acks = [&] ( const size_t index ) {
+      UDPSocket & receiver_side = flows.at( index ).receiver_side;
+      poller.add_action( Action( receiver_side, Direction::In, [&, index] () {
+	    flows.at( index ).receiver_side.recv_batch( batch );
+	    const uint64_t now = timestamp_us();
+	    advance_links( now );
+	    for ( const auto & recd : batch ) {
+	      downlink->send( LinkPacket { index, recd.length + HEADER_BYTES,
+					   string( recd.payload, recd.length ), 0, 0, 0, 0, 0 }, now );
+	    }
+	    return ResultType::Continue;
+	  } ) );
+    };
+
+    /* third rule: stop on SIGINT or SIGTERM */
+    poller.add_action( Action( signal_fd, Direction::In, [&] () {
+	  signal_fd.read( sizeof( signalfd_siginfo ) );
+	  return Result( ResultType::Exit, EXIT_SUCCESS );
+	} ) );
+
+    /* fourth rule: wake up for the next delivery on either link
+       (rescheduled before every poll, so it never fires otherwise) */
+    const Poller::TimerID delivery_timer = poller.add_timer( IDLE_NS, [&] () {
+	advance_links( timestamp_us() );
+	return ResultType::Continue;
+      }, IDLE_NS );
+
+    while ( true ) {
+      while ( flows_registered < flows.size() ) {
+	listen_for_acks( flows_registered++ );
+      }
+
+      const uint64_t next = min( uplink.next_delivery_us(), downlink->next_delivery_us() );
+      const uint64_t now = timestamp_us();
+      if ( next == numeric_limits<uint64_t>::max() ) {
+	poller.reschedule_timer( delivery_timer, IDLE_NS );
+      } else {
+	poller.reschedule_timer( delivery_timer, next > now ? (next - now) * THOUSAND_NS : 0 );
+      }
+
+      const auto ret = poller.poll( -1 );
+      if ( ret.result == PollResult::Exit ) {
+	return ret.exit_status;
+      }
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+}
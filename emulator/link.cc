@@ -0,0 +1,153 @@
+#include <limits>
+
+#include "link.hh"
+
+using namespace std;
+
+Link::Link( const DeliveryTrace & trace, const PacketQueue & queue,
+	    const uint64_t delay_us, const uint64_t base_us )
+  : trace_( new DeliveryTrace( trace ) ),
+    queue_( queue ),
+    delay_us_( delay_us ),
+    base_us_( base_us ),
+    next_opportunity_( 0 ),
+    busy_( false ),
+    in_transit_( { 0, 0, "", 0, 0, 0, 0, 0 } ),
+    in_transit_bytes_left_( 0 ),
+    propagating_(),
+    dropped_packets_( 0 ),
+    log_( nullptr )
+{}
+
+Link::Link( const uint64_t delay_us, const uint64_t base_us )
+  : trace_(),
+    queue_( PacketQueue::Discipline::Infinite, 0, 0 ),
+    delay_us_( delay_us ),
+    base_us_( base_us ),
+    next_opportunity_( 0 ),
+    busy_( false ),
+    in_transit_( { 0, 0, "", 0, 0, 0, 0, 0 } ),
+    in_transit_bytes_left_( 0 ),
+    propagating_(),
+    dropped_packets_( 0 ),
+    log_( nullptr )
+{}
+
+void Link::set_log( ostream & log, const string & command_line )
+{
+  log_ = &log;
+
+  *log_ << "# mahimahi mm-link [" << (trace_ ? trace_->name() : "unlimited") << "]" << endl
+	<< "# command line: " << command_line << endl
+	<< "# queue: " << queue_.to_string() << endl
+	<< "# init timestamp: " << base_us_ / 1000 << endl
+	<< "# base timestamp: 0" << endl;
+}
+
+/* start a log line: times are in ms relative to the start of the trace */
+ostream & Link::log( const uint64_t time_us )
+{
+  return *log_ << (time_us - base_us_) / 1000;
+}
+
+uint64_t Link::opportunity_us( const uint64_t index ) const
+{
+  return trace_ ? base_us_ + trace_->opportunity_ms( index ) * 1000
+                : numeric_limits<uint64_t>::max();
+}
+
+void Link::send( LinkPacket && packet, const uint64_t now_us )
+{
+  packet.arrival_us = now_us;
+  if ( log_ ) {
+    log( now_us ) << " + " << packet.size << "\n";
+  }
+
+  if ( not trace_ ) {
+    /* unlimited capacity: straight through the queue */
+    packet.departure_us = now_us;
+    packet.delivery_us = now_us + delay_us_;
+    if ( log_ ) {
+      log( now_us ) << " - " << packet.size << " 0\n";
+    }
+    propagating_.emplace_back( move( packet ) );
+    return;
+  }
+
+  const auto drops = queue_.enqueue( move( packet ) );
+  dropped_packets_ += drops.packets;
+  if ( log_ and drops.packets ) {
+    log( now_us ) << " d " << drops.packets << " " << drops.bytes << "\n";
+  }
+}
+
+/* serve the queue with one opportunity's worth of bytes */
+void Link::use_opportunity( const uint64_t now_us )
+{
+  if ( log_ ) {
+    log( now_us ) << " # " << OPPORTUNITY_BYTES << "\n";
+  }
+
+  uint64_t bytes_left = OPPORTUNITY_BYTES;
+  while ( bytes_left > 0 ) {
+    if ( not busy_ ) {
+      if ( queue_.empty() ) {
+	return; /* the rest of this opportunity goes unused */
+      }
+
+      in_transit_ = queue_.dequeue();
+      in_transit_bytes_left_ = in_transit_.size;
+      busy_ = true;
+    }
+
+    const uint64_t sent = min( bytes_left, in_transit_bytes_left_ );
+    bytes_left -= sent;
+    in_transit_bytes_left_ -= sent;
+
+    if ( in_transit_bytes_left_ == 0 ) {
+      in_transit_.departure_us = now_us;
+      in_transit_.delivery_us = now_us + delay_us_;
+      if ( log_ ) {
+	log( now_us ) << " - " << in_transit_.size << " "
+		      << (now_us - in_transit_.arrival_us) / 1000 << "\n";
+      }
+      propagating_.emplace_back( move( in_transit_ ) );
+      busy_ = false;
+    }
+  }
+}
+
+uint64_t Link::next_delivery_us( void ) const
+{
+  if ( not propagating_.empty() ) {
+    return propagating_.front().delivery_us;
+  }
+
+  if ( busy_ or not queue_.empty() ) {
+    /* at best, the next opportunity sends it */
+    return opportunity_us( next_opportunity_ ) + delay_us_;
+  }
+
+  return numeric_limits<uint64_t>::max();
+}
+
+void Link::advance_to( const uint64_t now_us, const function<void( LinkPacket && )> & deliver )
+{
+  while ( true ) {
+    /* whichever comes first: the next opportunity or the next arrival at the far end */
+    const uint64_t opportunity = opportunity_us( next_opportunity_ );
+    const bool deliver_first = not propagating_.empty()
+      and propagating_.front().delivery_us <= opportunity;
+
+    if ( deliver_first and propagating_.front().delivery_us <= now_us ) {
+      LinkPacket packet = move( propagating_.front() );
+      propagating_.pop_front();
+      deliver( move( packet ) );
+    } else if ( not deliver_first and opportunity <= now_us ) {
+      use_opportunity( opportunity );
+      next_opportunity_++;
+    } else {
+      break;
+    }
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef LINK_HH
+#define LINK_HH
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "delivery_trace.hh"
+#include "packet_queue.hh"
+
+/* One direction of an emulated network path, like mahimahi's
+   mm-link inside mm-delay: packets wait in a queue that is served
+   at each delivery opportunity of a trace, then take a fixed
+   propagation delay to reach the far end. Without a trace, the
+   link has unlimited capacity and only delays packets.
+
+   The link has no clock of its own. Callers pass the current time
+   (in microseconds, on any clock) to every method, so it runs the
+   same against the real clock or a simulated one. */
+
+class Link
+{
+private:
+  std::unique_ptr<DeliveryTrace> trace_; /* null for unlimited capacity */
+  PacketQueue queue_;
+  uint64_t delay_us_;
+  uint64_t base_us_; /* when the trace starts */
+
+  uint64_t next_opportunity_; /* index into the trace */
+
+  /* the packet being served, and how many of its bytes are still to go */
+  bool busy_;
+  LinkPacket in_transit_;
+  uint64_t in_transit_bytes_left_;
+
+  /* packets that have left the queue, in order of delivery */
+  std::deque<LinkPacket> propagating_;
+
+  uint64_t dropped_packets_;
+
+  std::ostream * log_;
+
+  uint64_t opportunity_us( const uint64_t index ) const;
+  void use_opportunity( const uint64_t now_us );
+  std::ostream & log( const uint64_t time_us );
+
+public:
+  /* bytes a delivery opportunity can carry (an MTU plus the tun header, as in mahimahi) */
+  static const uint64_t OPPORTUNITY_BYTES = 1504;
+
+  Link( const DeliveryTrace & trace, const PacketQueue & queue,
+	const uint64_t delay_us, const uint64_t base_us );
+
+  /* a link that only delays packets */
+  Link( const uint64_t delay_us, const uint64_t base_us );
+
+  /* write a mahimahi-format log (for mm-throughput-graph and friends) */
+  void set_log( std::ostream & log, const std::string & command_line );
+
+  /* a packet enters the link (after advance_to( now_us )) */
+  void send( LinkPacket && packet, const uint64_t now_us );
+
+  /* the earliest time anything will reach the far end
+     (or UINT64_MAX if the link is empty) */
+  uint64_t next_delivery_us( void ) const;
+
+  /* run the link up to now_us, handing deliver every packet that has arrived by then */
+  void advance_to( const uint64_t now_us, const std::function<void( LinkPacket && )> & deliver );
+
+  /* forbid copying (the log belongs to whoever set it) */
+  Link( const Link & other ) = delete;
+  Link & operator=( const Link & other ) = delete;
+
+  bool empty( void ) const { return not busy_ and queue_.empty() and propagating_.empty(); }
+  const PacketQueue & queue( void ) const { return queue_; }
+
+  /* packets the queue has thrown away */
+  uint64_t dropped_packets( void ) const { return dropped_packets_; }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include <stdexcept>
+
+#include "packet_queue.hh"
+
+using namespace std;
+
+PacketQueue::PacketQueue( const Discipline discipline,
+			  const uint64_t packet_limit, const uint64_t byte_limit )
+  : discipline_( discipline ),
+    packet_limit_( packet_limit ),
+    byte_limit_( byte_limit ),
+    packets_(),
+    bytes_( 0 )
+{
+  if ( discipline_ == Discipline::Infinite and (packet_limit_ or byte_limit_) ) {
+    throw runtime_error( "an infinite queue can't have a limit" );
+  }
+
+  if ( discipline_ != Discipline::Infinite and not packet_limit_ and not byte_limit_ ) {
+    throw runtime_error( "a finite queue needs a packet or byte limit" );
+  }
+}
+
+PacketQueue::Discipline PacketQueue::parse_discipline( const string & name )
+{
+  if ( name == "infinite" ) {
+    return Discipline::Infinite;
+  } else if ( name == "droptail" ) {
+    return Discipline::DropTail;
+  } else if ( name == "drophead" ) {
+    return Discipline::DropHead;
+  }
+
+  throw runtime_error( "unknown queue discipline " + name
+		       + " (known: infinite, droptail, drophead)" );
+}
+
+PacketQueue PacketQueue::make( const string & discipline,
+			      const uint64_t packet_limit, const uint64_t byte_limit )
+{
+  const string name = not discipline.empty() ? discipline
+    : (packet_limit or byte_limit) ? "droptail" : "infinite";
+
+  return PacketQueue( parse_discipline( name ), packet_limit, byte_limit );
+}
+
+/* would the queue be too long with this much more in it? */
+bool PacketQueue::over_limit( const uint64_t extra_packets, const uint64_t extra_bytes ) const
+{
+  return (packet_limit_ and packets_.size() + extra_packets > packet_limit_)
+    or (byte_limit_ and bytes_ + extra_bytes > byte_limit_);
+}
+
+PacketQueue::Drops PacketQueue::enqueue( LinkPacket && packet )
+{
+  Drops drops { 0, 0 };
+
+  if ( discipline_ == Discipline::DropTail and over_limit( 1, packet.size ) ) {
+    drops.packets++;
+    drops.bytes += packet.size;
+    return drops;
+  }
+
+  bytes_ += packet.size;
+  packets_.emplace_back( move( packet ) );
+
+  /* drophead makes room by discarding the oldest packets (maybe the new one too) */
+  while ( discipline_ == Discipline::DropHead and not packets_.empty() and over_limit( 0, 0 ) ) {
+    drops.packets++;
+    drops.bytes += packets_.front().size;
+    dequeue();
+  }
+
+  return drops;
+}
+
+LinkPacket PacketQueue::dequeue( void )
+{
+  LinkPacket ret = move( packets_.front() );
+  packets_.pop_front();
+  bytes_ -= ret.size;
+  return ret;
+}
+
+string PacketQueue::to_string( void ) const
+{
+  string ret;
+  switch ( discipline_ ) {
+  case Discipline::Infinite:
+    return "infinite";
+  case Discipline::DropTail:
+    ret = "droptail";
+    break;
+  case Discipline::DropHead:
+    ret = "drophead";
+    break;
+  }
+
+  ret += " [";
+  if ( packet_limit_ ) {
+    ret += "packets=" + std::to_string( packet_limit_ );
+  }
+  if ( byte_limit_ ) {
+    ret += string( packet_limit_ ? ", " : "" ) + "bytes=" + std::to_string( byte_limit_ );
+  }
+  return ret + "]";
+}
@@ -0,0 +1,72 @@
+#ifndef PACKET_QUEUE_HH
+#define PACKET_QUEUE_HH
+
+#include <cstdint>
+#include <deque>
+#include <string>
+
+/* a packet crossing the emulated link */
+struct LinkPacket
+{
+  uint64_t id;           /* caller's tag (e.g., a sequence number) */
+  uint64_t size;         /* bytes on the wire, used to serve the queue */
+  std::string contents;  /* carried along untouched (may be empty) */
+  uint64_t send_us;      /* also carried along: a datagram's send time, */
+  uint64_t recv_us;      /*   or the send and receive times an ack echoes */
+
+  uint64_t arrival_us;   /* when it entered the link */
+  uint64_t departure_us; /* when the last byte left the queue */
+  uint64_t delivery_us;  /* when it reaches the far end */
+};
+
+/* the bottleneck queue, with one of mahimahi's disciplines */
+class PacketQueue
+{
+public:
+  enum class Discipline { Infinite, DropTail, DropHead };
+
+  /* what an enqueue threw away */
+  struct Drops
+  {
+    unsigned int packets;
+    uint64_t bytes;
+  };
+
+private:
+  Discipline discipline_;
+  uint64_t packet_limit_; /* 0 for none */
+  uint64_t byte_limit_;   /* 0 for none */
+
+  std::deque<LinkPacket> packets_;
+  uint64_t bytes_;
+
+  bool over_limit( const uint64_t extra_packets, const uint64_t extra_bytes ) const;
+
+public:
+  /* limits of 0 mean no limit (an infinite queue has none) */
+  PacketQueue( const Discipline discipline,
+	       const uint64_t packet_limit, const uint64_t byte_limit );
+
+  /* "infinite", "droptail", or "drophead" */
+  static Discipline parse_discipline( const std::string & name );
+
+  /* a queue from command-line settings: with no discipline named,
+     droptail if there is a limit and infinite otherwise */
+  static PacketQueue make( const std::string & discipline,
+			   const uint64_t packet_limit, const uint64_t byte_limit );
+
+  /* add a packet, dropping it or others if the queue is full */
+  Drops enqueue( LinkPacket && packet );
+
+  bool empty( void ) const { return packets_.empty(); }
+  LinkPacket & front( void ) { return packets_.front(); }
+  LinkPacket dequeue( void );
+
+  uint64_t size_packets( void ) const { return packets_.size(); }
+  uint64_t size_bytes( void ) const { return bytes_; }
+
+  /* e.g. "droptail [packets=100, bytes=150000]" (as in mahimahi's logs) */
+  std::string to_string( void ) const;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "flight_recorder.hh"
+#include "util.hh"
+
+using namespace std;
+
+const char FlightRecorder::MAGIC[ 8 ] = { 'F', 'L', 'I', 'G', 'H', 'T', 'R', 'C' };
+
+/* records start on their own cache line */
+static const size_t HEADER_SPACE = 64;
+
+static_assert( sizeof( FlightRecorder::Header ) <= HEADER_SPACE, "FlightRecorder header too big" );
+static_assert( sizeof( FlightRecord ) == 32, "FlightRecord should be 32 bytes" );
+
+static atomic<FlightRecorder *> running_recorder( nullptr );
+
+FlightRecorder::FlightRecorder( const string & filename, const size_t capacity )
+  : fd_( SystemCall( "open " + filename,
+		     open( filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 ) ) ),
+    length_( HEADER_SPACE + capacity * sizeof( FlightRecord ) ),
+    header_( nullptr ),
+    records_( nullptr )
+{
+  if ( capacity == 0 ) {
+    throw runtime_error( "FlightRecorder: capacity must be positive" );
+  }
+
+  /* a fresh file reads as zeros, which is an empty ring */
+  SystemCall( "ftruncate", ftruncate( fd_.fd_num(), length_ ) );
+
+  void * const mapping = mmap( nullptr, length_, PROT_READ | PROT_WRITE, MAP_SHARED,
+			       fd_.fd_num(), 0 );
+  if ( mapping == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+
+  header_ = static_cast<Header *>( mapping );
+  records_ = reinterpret_cast<FlightRecord *>( static_cast<char *>( mapping ) + HEADER_SPACE );
+
+  memcpy( header_->magic, MAGIC, sizeof( MAGIC ) );
+  header_->version = VERSION;
+  header_->record_size = sizeof( FlightRecord );
+  header_->capacity = capacity;
+
+  FlightRecorder * expected = nullptr;
+  if ( not running_recorder.compare_exchange_strong( expected, this ) ) {
+    munmap( mapping, length_ );
+    throw runtime_error( "FlightRecorder: another recorder is already running" );
+  }
+}
+
+FlightRecorder::~FlightRecorder()
+{
+  running_recorder = nullptr;
+
+  /* the kernel writes the pages back even if we never get here */
+  munmap( header_, length_ );
+}
+
+void FlightRecorder::record( const FlightRecord & record )
+{
+  const uint64_t index = header_->written.fetch_add( 1, memory_order_relaxed );
+  records_[ index % header_->capacity ] = record;
+}
+
+void flight_record( const uint64_t timestamp, const FlightEvent type, const uint16_t flow,
+		    const uint64_t sequence_number, const uint32_t count, const uint64_t value )
+{
+  FlightRecorder * const recorder = running_recorder.load( memory_order_relaxed );
+  if ( recorder ) {
+    recorder->record( { timestamp, type, 0, flow, count, sequence_number, value } );
+  }
+}
+
+bool flight_recording( void )
+{
+  return running_recorder.load( memory_order_relaxed ) != nullptr;
+}
+
+vector<FlightRecord> read_flight_log( const string & filename )
+{
+  ifstream file( filename, ios::binary );
+  if ( not file ) {
+    throw runtime_error( "can't open " + filename );
+  }
+
+  char magic[ sizeof( FlightRecorder::MAGIC ) ];
+  uint32_t version = 0, record_size = 0;
+  uint64_t capacity = 0, written = 0;
+
+  file.read( magic, sizeof( magic ) );
+  file.read( reinterpret_cast<char *>( &version ), sizeof( version ) );
+  file.read( reinterpret_cast<char *>( &record_size ), sizeof( record_size ) );
+  file.read( reinterpret_cast<char *>( &capacity ), sizeof( capacity ) );
+  file.read( reinterpret_cast<char *>( &written ), sizeof( written ) );
+
+  if ( not file or memcmp( magic, FlightRecorder::MAGIC, sizeof( magic ) ) ) {
+    throw runtime_error( filename + " is not a flight recorder log" );
+  }
+
+  if ( version != FlightRecorder::VERSION or record_size != sizeof( FlightRecord ) ) {
+    throw runtime_error( filename + " has an unsupported flight recorder format" );
+  }
+
+  /* the ring may have wrapped: the oldest surviving record follows the newest */
+  vector<FlightRecord> ring( min( written, capacity ) );
+  file.seekg( HEADER_SPACE );
+  file.read( reinterpret_cast<char *>( ring.data() ), ring.size() * sizeof( FlightRecord ) );
+  if ( not file ) {
+    throw runtime_error( filename + " is truncated" );
+  }
+
+  vector<FlightRecord> ret;
+  ret.reserve( ring.size() );
+  for ( uint64_t i = written - ring.size(); i < written; i++ ) {
+    ret.push_back( ring[ i % capacity ] );
+  }
+
+  return ret;
+}
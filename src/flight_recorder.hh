@@ -0,0 +1,86 @@
+#ifndef FLIGHT_RECORDER_HH
+#define FLIGHT_RECORDER_HH
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "file_descriptor.hh"
+
+/* A binary log of every send, ack, loss, window change and controller
+   state transition, written into a memory-mapped ring file (the newest
+   capacity records survive). Writing a record is a few stores into the
+   mapping -- no syscalls and no formatting -- so the recorder can stay on
+   for whole runs; flight-decoder turns the file into CSV or JSON. */
+
+enum class FlightEvent : uint8_t {
+  Sent,    /* sequence_number; count: 1 if a retransmission; value: bytes */
+  Acked,   /* sequence_number: newest acked; count: newly acked; value: RTT (us) */
+  Lost,    /* sequence_number: newest lost; count: datagrams lost; value: in flight */
+  Timeout, /* count: what fired (a FlightTimeout) */
+  Window,  /* count: window (datagrams); value: pacing rate (datagrams/s) */
+  State,   /* count: the controller's new state (a ControllerState) */
+  COUNT
+};
+
+enum class FlightTimeout : uint32_t { Loss, Probe, RTO, Silence };
+
+struct FlightRecord
+{
+  uint64_t timestamp;        /* us */
+  FlightEvent type;
+  uint8_t reserved;
+  uint16_t flow;
+  uint32_t count;
+  uint64_t sequence_number;
+  uint64_t value;
+};
+
+class FlightRecorder
+{
+public:
+  /* the start of the file */
+  struct Header
+  {
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;               /* records */
+    std::atomic<uint64_t> written;   /* records ever written (the ring wraps) */
+  };
+
+  static const char MAGIC[ 8 ];
+  static const uint32_t VERSION = 1;
+
+private:
+  FileDescriptor fd_;
+  size_t length_;
+  Header * header_;
+  FlightRecord * records_;
+
+public:
+  /* create (or truncate) the file, sized for capacity records, and
+     start recording into it (one recorder at a time) */
+  FlightRecorder( const std::string & filename, const size_t capacity );
+  ~FlightRecorder();
+
+  /* safe to call from any thread */
+  void record( const FlightRecord & record );
+
+  /* forbid copying */
+  FlightRecorder( const FlightRecorder & other ) = delete;
+  FlightRecorder & operator=( const FlightRecorder & other ) = delete;
+};
+
+/* log to the running recorder, if any */
+void flight_record( const uint64_t timestamp, const FlightEvent type, const uint16_t flow,
+		    const uint64_t sequence_number, const uint32_t count, const uint64_t value );
+
+/* is a recorder running? (to skip work that only feeds it) */
+bool flight_recording( void );
+
+/* every record in a recorder's file, oldest first */
+std::vector<FlightRecord> read_flight_log( const std::string & filename );
+
+#endif /* FLIGHT_RECORDER_HH */
@@ -0,0 +1,111 @@
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "histogram.hh"
+
+using namespace std;
+
+Histogram::Histogram( const unsigned int precision_bits )
+  : precision_bits_( precision_bits ),
+    counts_(),
+    count_( 0 ),
+    sum_( 0 ),
+    min_( numeric_limits<uint64_t>::max() ),
+    max_( 0 )
+{
+  if ( precision_bits_ < 1 or precision_bits_ > 32 ) {
+    throw runtime_error( "Histogram: precision must be between 1 and 32 bits" );
+  }
+}
+
+/* values below 2^precision get one bucket each; above that, each power
+   of two is split into 2^(precision - 1) equal buckets */
+size_t Histogram::index_of( const uint64_t value ) const
+{
+  const unsigned int most_significant_bit = value ? 63 - __builtin_clzll( value ) : 0;
+  const unsigned int shift = most_significant_bit < precision_bits_
+    ? 0 : most_significant_bit - precision_bits_ + 1;
+
+  return (size_t( shift ) << (precision_bits_ - 1)) + (value >> shift);
+}
+
+/* the middle of a bucket */
+uint64_t Histogram::value_of( const size_t index ) const
+{
+  const size_t half = size_t( 1 ) << (precision_bits_ - 1);
+  if ( index < 2 * half ) {
+    return index;
+  }
+
+  const unsigned int shift = index / half - 1;
+  const uint64_t low = uint64_t( index - shift * half ) << shift;
+  return low + ((uint64_t( 1 ) << shift) - 1) / 2;
+}
+
+void Histogram::add( const uint64_t value, const uint64_t count )
+{
+  if ( count == 0 ) {
+    return;
+  }
+
+  const size_t index = index_of( value );
+  if ( index >= counts_.size() ) {
+    counts_.resize( index + 1 );
+  }
+
+  counts_[ index ] += count;
+  count_ += count;
+  sum_ += double( value ) * count;
+  min_ = std::min( min_, value );
+  max_ = std::max( max_, value );
+}
+
+void Histogram::merge( const Histogram & other )
+{
+  if ( other.precision_bits_ != precision_bits_ ) {
+    throw runtime_error( "Histogram: can't merge histograms of different precision" );
+  }
+
+  if ( other.counts_.size() > counts_.size() ) {
+    counts_.resize( other.counts_.size() );
+  }
+
+  for ( size_t i = 0; i < other.counts_.size(); i++ ) {
+    counts_[ i ] += other.counts_[ i ];
+  }
+
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min( min_, other.min_ );
+  max_ = std::max( max_, other.max_ );
+}
+
+void Histogram::clear( void )
+{
+  counts_.clear();
+  count_ = 0;
+  sum_ = 0;
+  min_ = numeric_limits<uint64_t>::max();
+  max_ = 0;
+}
+
+uint64_t Histogram::quantile( const double q ) const
+{
+  if ( count_ == 0 ) {
+    return 0;
+  }
+
+  /* rank of the sample we want, counting from 1 */
+  const uint64_t rank = std::max<uint64_t>( 1, ceil( q * count_ ) );
+
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < counts_.size(); i++ ) {
+    seen += counts_[ i ];
+    if ( seen >= rank ) {
+      return std::min( std::max( value_of( i ), min_ ), max_ );
+    }
+  }
+
+  return max_;
+}
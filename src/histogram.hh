@@ -0,0 +1,50 @@
+#ifndef HISTOGRAM_HH
+#define HISTOGRAM_HH
+
+#include <cstdint>
+#include <vector>
+
+/* Streaming quantiles in bounded memory: a log-linear histogram
+   (in the style of HdrHistogram) of unsigned integer samples.
+   Values below 2^precision_bits are counted exactly; larger ones
+   fall into buckets no wider than 2^-(precision_bits - 1) of their
+   value, so quantiles have at most that relative error. */
+
+class Histogram
+{
+private:
+  unsigned int precision_bits_;
+  std::vector<uint64_t> counts_; /* grows to the largest bucket used */
+
+  uint64_t count_;
+  double sum_;
+  uint64_t min_, max_;
+
+public:
+  Histogram( const unsigned int precision_bits = 10 );
+
+  /* the bucket a value falls in, and the value a bucket stands for
+     (for keeping counts elsewhere and adding them in later) */
+  size_t index_of( const uint64_t value ) const;
+  uint64_t value_of( const size_t index ) const;
+
+  /* record a sample (or several of the same value) */
+  void add( const uint64_t value, const uint64_t count = 1 );
+
+  /* add in another histogram's samples (same precision) */
+  void merge( const Histogram & other );
+
+  void clear( void );
+
+  uint64_t count( void ) const { return count_; }
+  bool empty( void ) const { return count_ == 0; }
+  uint64_t min( void ) const { return min_; }
+  uint64_t max( void ) const { return max_; }
+  double mean( void ) const { return count_ ? sum_ / count_ : 0; }
+
+  /* smallest recorded value with at least a q fraction of samples at or below it
+     (0 if empty) */
+  uint64_t quantile( const double q ) const;
+};
+
+#endif /* HISTOGRAM_HH */
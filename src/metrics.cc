@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "metrics.hh"
+#include "histogram.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+static const size_t COUNTERS = size_t( Counter::COUNT );
+static const size_t LATENCIES = size_t( Latency::COUNT );
+
+/* names in the exported JSON */
+static const char * const counter_names[ COUNTERS ] = {
+  "datagrams_sent", "acks_received", "timeouts", "probe_rtt_entries", "poll_wakeups"
+};
+
+static const char * const latency_names[ LATENCIES ] = {
+  "rtt_ns", "queueing_delay_ns", "ack_processing_ns", "syscall_ns"
+};
+
+/* shard histograms: 1/64 relative error, up to about 18 minutes
+   (longer latencies are counted as that) */
+static const unsigned int PRECISION_BITS = 7;
+static const uint64_t MAX_LATENCY_NS = (uint64_t( 1 ) << 40) - 1;
+static const Histogram shape( PRECISION_BITS );
+static const size_t BUCKETS = shape.index_of( MAX_LATENCY_NS ) + 1;
+
+namespace {
+  /* one thread's metrics (everything only its thread writes, except
+     what was last exported, which only the exporter touches) */
+  struct Shard
+  {
+    atomic<uint64_t> counters[ COUNTERS ];
+
+    unique_ptr<atomic<uint64_t>[]> buckets; /* LATENCIES x BUCKETS, since the start */
+    atomic<uint64_t> sums[ LATENCIES ];     /* ns */
+
+    vector<uint64_t> exported_buckets;
+    uint64_t exported_sums[ LATENCIES ];
+
+    Shard()
+      : counters(),
+	buckets( new atomic<uint64_t>[ LATENCIES * BUCKETS ]() ),
+	sums(),
+	exported_buckets( LATENCIES * BUCKETS ),
+	exported_sums()
+    {}
+  };
+
+  /* every thread's shard (kept after the thread exits, so counts aren't lost) */
+  mutex shards_mutex;
+  vector<unique_ptr<Shard>> shards;
+
+  thread_local Shard * this_thread_shard = nullptr;
+
+  atomic<unsigned int> exporters( 0 );
+
+  Shard & shard( void )
+  {
+    if ( not this_thread_shard ) {
+      lock_guard<mutex> lock( shards_mutex );
+      shards.emplace_back( new Shard );
+      this_thread_shard = shards.back().get();
+    }
+
+    return *this_thread_shard;
+  }
+
+  /* only this thread writes its shard, so no read-modify-write is needed */
+  void bump( atomic<uint64_t> & value, const uint64_t n )
+  {
+    value.store( value.load( memory_order_relaxed ) + n, memory_order_relaxed );
+  }
+}
+
+void count_event( const Counter counter, const uint64_t n )
+{
+  bump( shard().counters[ size_t( counter ) ], n );
+}
+
+void record_latency( const Latency latency, const uint64_t ns )
+{
+  if ( not latency_timing_enabled() ) {
+    return;
+  }
+
+  Shard & s = shard();
+  const uint64_t value = min( ns, MAX_LATENCY_NS );
+  bump( s.buckets[ size_t( latency ) * BUCKETS + shape.index_of( value ) ], 1 );
+  bump( s.sums[ size_t( latency ) ], value );
+}
+
+bool latency_timing_enabled( void )
+{
+  return exporters.load( memory_order_relaxed ) > 0;
+}
+
+LatencyTimer::LatencyTimer( const Latency latency )
+  : latency_( latency ),
+    enabled_( latency_timing_enabled() ),
+    start_ns_( enabled_ ? timestamp_ns() : 0 )
+{}
+
+LatencyTimer::~LatencyTimer()
+{
+  if ( enabled_ ) {
+    record_latency( latency_, timestamp_ns() - start_ns_ );
+  }
+}
+
+MetricsExporter::MetricsExporter( const string & filename, const uint64_t interval_ms )
+  : file_( filename, ios::app ),
+    interval_ms_( interval_ms ),
+    last_export_ms_( timestamp_ms() ),
+    mutex_(),
+    stop_requested_(),
+    stopping_( false ),
+    thread_()
+{
+  if ( not file_ ) {
+    throw runtime_error( "MetricsExporter: can't open " + filename );
+  }
+
+  exporters++;
+  thread_ = thread( [this] () { run(); } );
+}
+
+MetricsExporter::~MetricsExporter()
+{
+  {
+    lock_guard<mutex> lock( mutex_ );
+    stopping_ = true;
+  }
+  stop_requested_.notify_one();
+  thread_.join();
+
+  exporters--;
+}
+
+void MetricsExporter::run( void )
+{
+  unique_lock<mutex> lock( mutex_ );
+
+  while ( not stop_requested_.wait_for( lock, chrono::milliseconds( interval_ms_ ),
+					[this] () { return stopping_; } ) ) {
+    export_metrics();
+  }
+
+  export_metrics();
+}
+
+/* one line: {"time_ms":...,"interval_ms":...,"threads":...,
+   "counters":{...},"latencies":{"rtt_ns":{"count":...,"mean":...,"p50":...},...}} */
+void MetricsExporter::export_metrics( void )
+{
+  uint64_t counters[ COUNTERS ] = {};
+  vector<Histogram> histograms( LATENCIES, Histogram( PRECISION_BITS ) );
+  double sums[ LATENCIES ] = {};
+  size_t threads = 0;
+
+  {
+    lock_guard<mutex> lock( shards_mutex );
+    threads = shards.size();
+
+    for ( const auto & s : shards ) {
+      for ( size_t i = 0; i < COUNTERS; i++ ) {
+	counters[ i ] += s->counters[ i ].load( memory_order_relaxed );
+      }
+
+      /* what was recorded since the last export */
+      for ( size_t i = 0; i < LATENCIES; i++ ) {
+	for ( size_t bucket = 0; bucket < BUCKETS; bucket++ ) {
+	  const size_t index = i * BUCKETS + bucket;
+	  const uint64_t total = s->buckets[ index ].load( memory_order_relaxed );
+	  histograms[ i ].add( shape.value_of( bucket ), total - s->exported_buckets[ index ] );
+	  s->exported_buckets[ index ] = total;
+	}
+
+	const uint64_t sum = s->sums[ i ].load( memory_order_relaxed );
+	sums[ i ] += sum - s->exported_sums[ i ];
+	s->exported_sums[ i ] = sum;
+      }
+    }
+  }
+
+  const uint64_t now = timestamp_ms();
+
+  file_ << "{\"time_ms\":" << now
+	<< ",\"interval_ms\":" << now - last_export_ms_
+	<< ",\"threads\":" << threads
+	<< ",\"counters\":{";
+  for ( size_t i = 0; i < COUNTERS; i++ ) {
+    file_ << (i ? "," : "") << "\"" << counter_names[ i ] << "\":" << counters[ i ];
+  }
+
+  file_ << "},\"latencies\":{";
+  for ( size_t i = 0; i < LATENCIES; i++ ) {
+    const Histogram & h = histograms[ i ];
+    file_ << (i ? "," : "") << "\"" << latency_names[ i ] << "\":{"
+	  << "\"count\":" << h.count()
+	  << ",\"mean\":" << uint64_t( h.empty() ? 0 : sums[ i ] / h.count() )
+	  << ",\"min\":" << (h.empty() ? 0 : h.min())
+	  << ",\"p50\":" << h.quantile( .5 )
+	  << ",\"p90\":" << h.quantile( .9 )
+	  << ",\"p99\":" << h.quantile( .99 )
+	  << ",\"p999\":" << h.quantile( .999 )
+	  << ",\"max\":" << h.max() << "}";
+  }
+  file_ << "}}" << endl;
+
+  last_export_ms_ = now;
+}
@@ -0,0 +1,89 @@
+#ifndef METRICS_HH
+#define METRICS_HH
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/* Counters and latency histograms cheap enough to leave on in the hot path.
+
+   Each thread records into its own shard. A counter is an atomic that
+   only its thread writes, so bumping it is a plain load and store (no
+   locked instruction). A latency histogram is the same: a fixed array
+   of such atomics, one per bucket (HdrHistogram-style, see
+   histogram.hh), allocated with the shard. The exporter never resets
+   them; it reports the difference from what it saw last time.
+   Latencies are only recorded (and timed) while a MetricsExporter is
+   running. */
+
+enum class Counter {
+  DatagramsSent,
+  AcksReceived,
+  Timeouts,        /* loss-detector and no-ack timers that fired */
+  ProbeRTTEntries,
+  PollWakeups,
+  COUNT
+};
+
+enum class Latency { /* all in nanoseconds */
+  RTT,
+  QueueingDelay,   /* RTT above the min RTT */
+  AckProcessing,
+  Syscall,
+  COUNT
+};
+
+void count_event( const Counter counter, const uint64_t n = 1 );
+void record_latency( const Latency latency, const uint64_t ns );
+
+/* is anyone exporting the latencies? */
+bool latency_timing_enabled( void );
+
+/* times its own lifetime (if latency timing is enabled) */
+class LatencyTimer
+{
+private:
+  Latency latency_;
+  bool enabled_;
+  uint64_t start_ns_;
+
+public:
+  LatencyTimer( const Latency latency );
+  ~LatencyTimer();
+
+  /* forbid copying */
+  LatencyTimer( const LatencyTimer & other ) = delete;
+  LatencyTimer & operator=( const LatencyTimer & other ) = delete;
+};
+
+/* Every interval_ms (and once more when destroyed), sum every thread's
+   counters (since the start) and histograms (since the last export),
+   and append them to a file as one JSON object per line */
+class MetricsExporter
+{
+private:
+  std::ofstream file_;
+  uint64_t interval_ms_;
+  uint64_t last_export_ms_;
+
+  std::mutex mutex_;
+  std::condition_variable stop_requested_;
+  bool stopping_;
+  std::thread thread_;
+
+  void run( void );
+  void export_metrics( void );
+
+public:
+  MetricsExporter( const std::string & filename, const uint64_t interval_ms );
+  ~MetricsExporter();
+
+  /* forbid copying */
+  MetricsExporter( const MetricsExporter & other ) = delete;
+  MetricsExporter & operator=( const MetricsExporter & other ) = delete;
+};
+
+#endif /* METRICS_HH */
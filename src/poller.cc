@@ -1,17 +1,69 @@
 #include <algorithm>
 #include <cassert>
+#include <limits>
 #include <numeric>
 
 #include "poller.hh"
+#include "metrics.hh"
+#include "timestamp.hh"
 #include "util.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
+/* most events to collect from one epoll_wait */
+static const size_t MAX_EPOLL_EVENTS = 64;
+
+/* a timer's queued_ns while its callback runs */
+static const uint64_t NOT_QUEUED = numeric_limits<uint64_t>::max();
+
+Poller::Poller( const Backend backend, const bool edge_triggered )
+  : backend_( backend ),
+    edge_triggered_( edge_triggered ),
+    actions_(),
+    pollfds_(),
+    epoll_fd_( backend == Backend::Epoll
+	       ? SystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) )
+	       : -1 ),
+    interested_(),
+    interested_count_( 0 ),
+    dirty_fds_(),
+    fd_actions_(),
+    registered_events_(),
+    epoll_events_( MAX_EPOLL_EVENTS ),
+    timer_fd_(),
+    next_timer_id_( 0 ),
+    timers_(),
+    timer_heap_(),
+    armed_deadline_ns_( 0 )
+{
+  if ( edge_triggered and backend != Backend::Epoll ) {
+    throw runtime_error( "Poller: edge-triggered mode needs the epoll backend" );
+  }
+
+  /* the timerfd is just another fd to wait on, while any timer is pending */
+  add_action( Action( timer_fd_, Direction::In,
+		      [&] () { return fire_timers(); },
+		      [&] () { return not timers_.empty(); } ) );
+}
+
 void Poller::add_action( Poller::Action action )
 {
   actions_.push_back( action );
   pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
+
+  /* epoll registration is deferred until the action is interested */
+  interested_.push_back( false );
+  fd_actions_[ action.fd.fd_num() ].push_back( actions_.size() - 1 );
+  mark_dirty( action.fd );
+}
+
+void Poller::mark_dirty( const FileDescriptor & fd )
+{
+  /* poll(2) asks every action before each poll anyway */
+  if ( backend_ == Backend::Epoll ) {
+    dirty_fds_.push_back( fd.fd_num() );
+  }
 }
 
 unsigned int Poller::Action::service_count( void ) const
@@ -19,21 +71,59 @@ unsigned int Poller::Action::service_count( void ) const
   return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+/* is the action interested in its event right now? */
+bool Poller::wants_event( const Action & action ) const
+{
+  /* don't poll in on fds that have had EOF */
+  if ( action.direction == Direction::In and action.fd.eof() ) {
+    return false;
+  }
+
+  return action.active and action.when_interested();
+}
+
+/* run the callback for an action that is ready; returns false if poll should exit */
+bool Poller::service( const size_t index, Result & exit_result )
+{
+  Action & action = actions_.at( index );
+
+  const auto count_before = action.service_count();
+  auto result = action.callback();
+
+  /* the callback (or an EOF it read) may have changed what the fd's actions want */
+  mark_dirty( action.fd );
+
+  if ( count_before == action.service_count() ) {
+    throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+  }
+
+  switch ( result.result ) {
+  case ResultType::Exit:
+    exit_result = Result( Result::Type::Exit, result.exit_status );
+    return false;
+  case ResultType::Cancel:
+    action.active = false;
+  case ResultType::Continue:
+    break;
+  }
+
+  return true;
+}
+
 Poller::Result Poller::poll( const int & timeout_ms )
+{
+  count_event( Counter::PollWakeups );
+  return backend_ == Backend::Epoll ? poll_epoll( timeout_ms ) : poll_poll( timeout_ms );
+}
+
+Poller::Result Poller::poll_poll( const int & timeout_ms )
 {
   assert( pollfds_.size() == actions_.size() );
 
   /* tell poll whether we care about each fd */
   for ( unsigned int i = 0; i < actions_.size(); i++ ) {
     assert( pollfds_.at( i ).fd == actions_.at( i ).fd.fd_num() );
-    pollfds_.at( i ).events = (actions_.at( i ).active and actions_.at( i ).when_interested())
-      ? actions_.at( i ).direction : 0;
-
-    /* don't poll in on fds that have had EOF */
-    if ( actions_.at( i ).direction == Direction::In
-	 and actions_.at( i ).fd.eof() ) {
-      pollfds_.at( i ).events = 0;
-    }
+    pollfds_.at( i ).events = wants_event( actions_.at( i ) ) ? actions_.at( i ).direction : 0;
   }
 
   /* Quit if no member in pollfds_ has a non-zero direction */
@@ -51,26 +141,255 @@ Poller::Result Poller::poll( const int & timeout_ms )
       return Result::Type::Exit;
     }
 
-    if ( pollfds_[ i ].revents & pollfds_[ i ].events ) {
-      /* we only want to call callback if revents includes
-	 the event we asked for */
-      const auto count_before = actions_.at( i ).service_count();
-      auto result = actions_.at( i ).callback();
+    /* we only want to call callback if revents includes
+       the event we asked for (and an earlier callback hasn't
+       changed whether this one is still interested) */
+    if ( (pollfds_[ i ].revents & pollfds_[ i ].events) and wants_event( actions_[ i ] ) ) {
+      Result exit_result = Result::Type::Exit;
+      if ( not service( i, exit_result ) ) {
+	return exit_result;
+      }
+    }
+  }
+
+  return Result::Type::Success;
+}
 
-      if ( count_before == actions_.at( i ).service_count() ) {
-	throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
+/* tell epoll about dirty fds whose actions' interest flipped;
+   returns whether any action is interested */
+bool Poller::update_epoll_interest( void )
+{
+  for ( const int fd : dirty_fds_ ) {
+    /* recompute what we want to hear about on this fd */
+    uint32_t events = 0;
+    for ( const size_t i : fd_actions_.at( fd ) ) {
+      const bool interested = wants_event( actions_[ i ] );
+      if ( interested != interested_[ i ] ) {
+	interested_[ i ] = interested;
+	if ( interested ) {
+	  interested_count_++;
+	} else {
+	  interested_count_--;
+	}
       }
 
-      switch ( result.result ) {
-      case ResultType::Exit:
-	return Result( Result::Type::Exit, result.exit_status );
-      case ResultType::Cancel:
-	actions_.at( i ).active = false;
-      case ResultType::Continue:
-	break;
+      if ( interested ) {
+	events |= actions_[ i ].direction == Direction::In ? EPOLLIN : EPOLLOUT;
+      }
+    }
+
+    const uint32_t old_events = registered_events_[ fd ];
+    if ( events == old_events ) {
+      continue;
+    }
+
+    epoll_event event;
+    zero( event );
+    event.events = events | (edge_triggered_ ? uint32_t( EPOLLET ) : 0);
+    event.data.fd = fd;
+
+    if ( events == 0 ) {
+      SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_DEL, fd, &event ) );
+    } else if ( old_events == 0 ) {
+      SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_ADD, fd, &event ) );
+    } else {
+      SystemCall( "epoll_ctl", epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_MOD, fd, &event ) );
+    }
+
+    registered_events_[ fd ] = events;
+  }
+
+  dirty_fds_.clear();
+
+  return interested_count_ > 0;
+}
+
+Poller::Result Poller::poll_epoll( const int & timeout_ms )
+{
+  /* Quit if no action is interested */
+  if ( not update_epoll_interest() ) {
+    return Result::Type::Exit;
+  }
+
+  const int ready = SystemCall( "epoll_wait",
+				epoll_wait( epoll_fd_.fd_num(), &epoll_events_[ 0 ],
+					    epoll_events_.size(), timeout_ms ) );
+  if ( ready == 0 ) {
+    return Result::Type::Timeout;
+  }
+
+  /* only visit the fds that are ready */
+  for ( int k = 0; k < ready; k++ ) {
+    const epoll_event & event = epoll_events_[ k ];
+
+    if ( event.events & (EPOLLERR | EPOLLHUP) ) {
+      return Result::Type::Exit;
+    }
+
+    /* even if nothing here wants it any more, look again before the next poll */
+    dirty_fds_.push_back( event.data.fd );
+
+    for ( const size_t i : fd_actions_.at( event.data.fd ) ) {
+      const uint32_t wanted = actions_[ i ].direction == Direction::In ? EPOLLIN : EPOLLOUT;
+
+      /* an earlier callback may have changed whether this one is still interested */
+      if ( (event.events & wanted) and interested_[ i ] and wants_event( actions_[ i ] ) ) {
+	Result exit_result = Result::Type::Exit;
+	if ( not service( i, exit_result ) ) {
+	  return exit_result;
+	}
       }
     }
   }
 
   return Result::Type::Success;
 }
+
+/* current time on the clock timers are measured against */
+uint64_t Poller::now_ns( void )
+{
+  return monotonic_ns();
+}
+
+Poller::TimerID Poller::add_timer( const uint64_t delay_ns,
+				   const Action::CallbackType & callback,
+				   const uint64_t interval_ns )
+{
+  const TimerID id = next_timer_id_++;
+  const uint64_t deadline_ns = now_ns() + delay_ns;
+
+  timers_.emplace( id, Timer { callback, deadline_ns, interval_ns, deadline_ns } );
+  timer_heap_.emplace( deadline_ns, id );
+  arm_timer_fd();
+  mark_dirty( timer_fd_ );
+
+  return id;
+}
+
+void Poller::reschedule_timer( const TimerID id, const uint64_t delay_ns )
+{
+  auto timer = timers_.find( id );
+  if ( timer == timers_.end() ) {
+    throw runtime_error( "Poller: reschedule of unknown timer" );
+  }
+
+  timer->second.deadline_ns = now_ns() + delay_ns;
+
+  /* later: the old entry will find the new deadline when it comes due */
+  if ( timer->second.deadline_ns >= timer->second.queued_ns ) {
+    return;
+  }
+
+  /* earlier: the old heap entry no longer matches, so it will be skipped */
+  timer->second.queued_ns = timer->second.deadline_ns;
+  timer_heap_.emplace( timer->second.deadline_ns, id );
+  arm_timer_fd();
+}
+
+void Poller::cancel_timer( const TimerID id )
+{
+  timers_.erase( id );
+  mark_dirty( timer_fd_ );
+}
+
+/* make sure the timerfd fires no later than the earliest live deadline */
+void Poller::arm_timer_fd( void )
+{
+  /* drop stale entries from the top of the heap */
+  while ( not timer_heap_.empty() ) {
+    const HeapEntry & top = timer_heap_.top();
+    const auto timer = timers_.find( top.second );
+    if ( timer != timers_.end() and timer->second.queued_ns == top.first ) {
+      break;
+    }
+    timer_heap_.pop();
+  }
+
+  /* keep frequent rescheduling from filling the heap with stale entries */
+  if ( timer_heap_.size() > 2 * timers_.size() + 64 ) {
+    decltype( timer_heap_ ) fresh;
+    for ( auto & timer : timers_ ) {
+      if ( timer.second.queued_ns != NOT_QUEUED ) {
+	timer.second.queued_ns = timer.second.deadline_ns;
+	fresh.emplace( timer.second.deadline_ns, timer.first );
+      }
+    }
+    swap( timer_heap_, fresh );
+  }
+
+  if ( timer_heap_.empty() ) {
+    if ( armed_deadline_ns_ ) {
+      timer_fd_.disarm();
+      armed_deadline_ns_ = 0;
+    }
+    return;
+  }
+
+  /* an armed timerfd that fires early costs a wakeup, which finds the
+     real deadline and arms again; re-arming only to move it later would
+     cost a syscall every time */
+  const uint64_t deadline_ns = timer_heap_.top().first;
+  if ( armed_deadline_ns_ and armed_deadline_ns_ <= deadline_ns ) {
+    return;
+  }
+
+  timer_fd_.arm( deadline_ns );
+  armed_deadline_ns_ = deadline_ns;
+}
+
+/* run the callbacks of every timer that has expired */
+Poller::Action::Result Poller::fire_timers( void )
+{
+  timer_fd_.expirations();
+  armed_deadline_ns_ = 0;
+
+  const uint64_t now = now_ns();
+
+  while ( not timer_heap_.empty() and timer_heap_.top().first <= now ) {
+    const HeapEntry entry = timer_heap_.top();
+    timer_heap_.pop();
+
+    auto timer = timers_.find( entry.second );
+    if ( timer == timers_.end() or timer->second.queued_ns != entry.first ) {
+      continue; /* stale */
+    }
+
+    /* pushed later since it was queued: queue it again at its real deadline */
+    if ( timer->second.deadline_ns > now ) {
+      timer->second.queued_ns = timer->second.deadline_ns;
+      timer_heap_.emplace( timer->second.deadline_ns, entry.second );
+      continue;
+    }
+
+    /* the callback may add or cancel timers, so look this one up again after
+       (and while it runs, the timer has no heap entry) */
+    const uint64_t deadline_ns = timer->second.deadline_ns;
+    timer->second.queued_ns = NOT_QUEUED;
+    const auto callback = timer->second.callback;
+    const auto result = callback();
+
+    timer = timers_.find( entry.second );
+    if ( timer == timers_.end() or timer->second.queued_ns != NOT_QUEUED ) {
+      /* cancelled or rescheduled by its own callback */
+    } else if ( result.result == ResultType::Cancel or timer->second.interval_ns == 0 ) {
+      timers_.erase( timer );
+    } else {
+      /* periodic: don't try to catch up on missed expirations */
+      timer->second.deadline_ns = deadline_ns + timer->second.interval_ns;
+      if ( timer->second.deadline_ns <= now ) {
+	timer->second.deadline_ns = now + timer->second.interval_ns;
+      }
+      timer->second.queued_ns = timer->second.deadline_ns;
+      timer_heap_.emplace( timer->second.deadline_ns, entry.second );
+    }
+
+    if ( result.result == ResultType::Exit ) {
+      arm_timer_fd();
+      return result;
+    }
+  }
+
+  arm_timer_fd();
+
+  return ResultType::Continue;
+}
@@ -3,10 +3,14 @@
 
 #include <functional>
 #include <vector>
+#include <queue>
+#include <unordered_map>
 
 #include <poll.h>
+#include <sys/epoll.h>
 
 #include "file_descriptor.hh"
+#include "timerfd.hh"
 
 class Poller
 {
@@ -39,11 +43,14 @@ public:
     unsigned int service_count( void ) const;
   };
 
-private:
-  std::vector< Action > actions_;
-  std::vector< pollfd > pollfds_;
+  /* how to wait for events */
+  enum class Backend {
+    Poll,  /* poll(2): rebuilds the fd list every time; works on any fd */
+    Epoll  /* epoll(7): cost scales with ready fds; not for regular files */
+  };
+
+  typedef uint64_t TimerID;
 
-public:
   struct Result
   {
     enum class Type { Success, Timeout, Exit } result;
@@ -52,9 +59,97 @@ public:
       : result( s_result ), exit_status( s_status ) {}
   };
 
-  Poller() : actions_(), pollfds_() {}
+private:
+  Backend backend_;
+  bool edge_triggered_;
+
+  std::vector< Action > actions_;
+  std::vector< pollfd > pollfds_;
+
+  /* epoll state: whether each action wants its event, and
+     which actions share each fd and what is registered for it
+     (only fds marked dirty are looked at again before a poll) */
+  FileDescriptor epoll_fd_;
+  std::vector< bool > interested_;
+  size_t interested_count_;
+  std::vector< int > dirty_fds_;
+  std::unordered_map< int, std::vector< size_t > > fd_actions_;
+  std::unordered_map< int, uint32_t > registered_events_;
+  std::vector< epoll_event > epoll_events_;
+
+  /* timers: a min-heap of deadlines over one timerfd armed for the earliest
+     (rescheduled or cancelled timers leave stale heap entries behind).
+     Pushing a deadline later leaves the timer's heap entry (and the
+     timerfd) where they were; when that entry comes due, the timer is
+     queued again at its real deadline. */
+  struct Timer
+  {
+    Action::CallbackType callback;
+    uint64_t deadline_ns;
+    uint64_t interval_ns;
+    uint64_t queued_ns;         /* key of the timer's live heap entry */
+  };
+
+  typedef std::pair< uint64_t, TimerID > HeapEntry; /* deadline, timer */
+
+  TimerFD timer_fd_;
+  TimerID next_timer_id_;
+  std::unordered_map< TimerID, Timer > timers_;
+  std::priority_queue< HeapEntry, std::vector< HeapEntry >, std::greater< HeapEntry > > timer_heap_;
+  uint64_t armed_deadline_ns_;
+
+  /* run the callbacks of every timer that has expired */
+  Action::Result fire_timers( void );
+
+  /* make sure the timerfd fires no later than the earliest live deadline */
+  void arm_timer_fd( void );
+
+  /* is the action interested in its event right now? */
+  bool wants_event( const Action & action ) const;
+
+  /* run the callback for an action that is ready; returns false if poll should exit */
+  bool service( const size_t index, Result & exit_result );
+
+  Result poll_poll( const int & timeout_ms );
+  Result poll_epoll( const int & timeout_ms );
+
+  /* tell epoll about dirty fds whose actions' interest flipped */
+  bool update_epoll_interest( void );
+
+public:
+  /* With edge_triggered (epoll only), an fd is only reported when it
+     becomes ready, so callbacks must drain it (e.g. read until EAGAIN) */
+  Poller( const Backend backend = Backend::Poll, const bool edge_triggered = false );
+
   void add_action( Action action );
   Result poll( const int & timeout_ms );
+
+  /* With the epoll backend, an action's when_interested is only asked
+     again after the poller services its fd, or after mark_dirty: call it
+     when something outside the fd's own callbacks may have changed the answer */
+  void mark_dirty( const FileDescriptor & fd );
+
+  /* call back delay_ns from now, and then every interval_ns if that is
+     nonzero (returning Cancel stops the timer; Exit makes poll() exit) */
+  TimerID add_timer( const uint64_t delay_ns,
+		     const Action::CallbackType & callback,
+		     const uint64_t interval_ns = 0 );
+
+  /* move a pending timer's next expiration to delay_ns from now */
+  void reschedule_timer( const TimerID id, const uint64_t delay_ns );
+
+  /* forget a timer (no effect if it has already finished) */
+  void cancel_timer( const TimerID id );
+
+  /* is the timer still scheduled to fire? */
+  bool timer_pending( const TimerID id ) const { return timers_.count( id ); }
+
+  /* current time on the clock timers are measured against */
+  static uint64_t now_ns( void );
+
+  /* forbid copying or moving a Poller (its timer action refers to itself) */
+  Poller( const Poller & other ) = delete;
+  Poller & operator=( const Poller & other ) = delete;
 };
 
 namespace PollerShortNames {
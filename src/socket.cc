@@ -1,11 +1,39 @@
+#include <cstring>
+
 #include <sys/socket.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
 
 #include "socket.hh"
 #include "util.hh"
 #include "timestamp.hh"
+#include "metrics.hh"
 
 using namespace std;
 
+/* Linux UDP segmentation offload (older libc headers may lack these) */
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+/* most segments (and bytes) the kernel accepts in one GSO super-buffer */
+static const size_t GSO_MAX_SEGMENTS = 64;
+static const size_t GSO_MAX_BYTES = 65507;
+
 /* default constructor for socket of (subclassed) domain and type */
 Socket::Socket( const int domain, const int type )
   : FileDescriptor( SystemCall( "socket", socket( domain, type, 0 ) ) )
@@ -75,6 +103,35 @@ void Socket::connect( const Address & address )
 				    address.size() ) );
 }
 
+/* what the kernel told us about a received datagram */
+struct control_info {
+  uint64_t timestamp;
+  size_t segment_size; /* nonzero if coalesced by GRO */
+};
+
+/* find the timestamp and GRO headers (if there are any) */
+static control_info parse_control( msghdr & header )
+{
+  control_info ret = { uint64_t( -1 ), 0 };
+
+  cmsghdr *hdr = CMSG_FIRSTHDR( &header );
+  while ( hdr ) {
+    if ( hdr->cmsg_level == SOL_SOCKET
+	 and hdr->cmsg_type == SO_TIMESTAMPNS ) {
+      const timespec * const kernel_time = reinterpret_cast<timespec *>( CMSG_DATA( hdr ) );
+      ret.timestamp = timestamp_us( *kernel_time );
+    } else if ( hdr->cmsg_level == SOL_UDP
+		and hdr->cmsg_type == UDP_GRO ) {
+      int segment_size;
+      memcpy( &segment_size, CMSG_DATA( hdr ), sizeof( segment_size ) );
+      ret.segment_size = segment_size;
+    }
+    hdr = CMSG_NXTHDR( &header, hdr );
+  }
+
+  return ret;
+}
+
 /* receive datagram and where it came from */
 UDPSocket::received_datagram UDPSocket::recv( void )
 {
@@ -115,18 +172,7 @@ UDPSocket::received_datagram UDPSocket::recv( void )
     throw runtime_error( "recvfrom (unhandled flag)" );
   }
 
-  uint64_t timestamp = -1;
-
-  /* find the timestamp header (if there is one) */
-  cmsghdr *ts_hdr = CMSG_FIRSTHDR( &header );
-  while ( ts_hdr ) {
-    if ( ts_hdr->cmsg_level == SOL_SOCKET
-	 and ts_hdr->cmsg_type == SO_TIMESTAMPNS ) {
-      const timespec * const kernel_time = reinterpret_cast<timespec *>( CMSG_DATA( ts_hdr ) );
-      timestamp = timestamp_ms( *kernel_time );
-    }
-    ts_hdr = CMSG_NXTHDR( &header, ts_hdr );
-  }
+  const uint64_t timestamp = parse_control( header ).timestamp;
 
   received_datagram ret = { Address( datagram_source_address,
 				     header.msg_namelen ),
@@ -136,20 +182,111 @@ UDPSocket::received_datagram UDPSocket::recv( void )
   return ret;
 }
 
+/* allocate buffers for a batch of datagrams up to mtu bytes each */
+UDPSocket::RecvBatch::RecvBatch( const size_t capacity, const size_t mtu )
+  : mtu_( mtu ),
+    payloads_( capacity * mtu ),
+    controls_( capacity * CONTROL_SIZE ),
+    addresses_( capacity ),
+    iovecs_( capacity ),
+    headers_( capacity ),
+    datagrams_()
+{
+  if ( capacity == 0 ) {
+    throw runtime_error( "RecvBatch capacity must be positive" );
+  }
+
+  datagrams_.reserve( capacity );
+
+  for ( size_t i = 0; i < capacity; i++ ) {
+    iovecs_[ i ].iov_base = &payloads_[ i * mtu_ ];
+    iovecs_[ i ].iov_len = mtu_;
+  }
+}
+
+/* receive a batch of datagrams, timestamps, and where they came from */
+size_t UDPSocket::recv_batch( RecvBatch & batch, const bool wait )
+{
+  batch.datagrams_.clear();
+
+  /* the kernel overwrites the lengths, so reset them before each call */
+  for ( size_t i = 0; i < batch.capacity(); i++ ) {
+    msghdr & header = batch.headers_[ i ].msg_hdr;
+    zero( header );
+
+    header.msg_name = &batch.addresses_[ i ];
+    header.msg_namelen = sizeof( batch.addresses_[ i ] );
+
+    header.msg_iov = &batch.iovecs_[ i ];
+    header.msg_iovlen = 1;
+
+    header.msg_control = &batch.controls_[ i * RecvBatch::CONTROL_SIZE ];
+    header.msg_controllen = RecvBatch::CONTROL_SIZE;
+  }
+
+  /* call recvmmsg, waiting (at most) for the first datagram */
+  int count = 0;
+  {
+    LatencyTimer timer( Latency::Syscall );
+    count = recvmmsg( fd_num(), &batch.headers_[ 0 ], batch.capacity(),
+		      wait ? MSG_WAITFORONE : MSG_DONTWAIT, nullptr );
+  }
+
+  register_read();
+
+  if ( count < 0 and not wait and (errno == EAGAIN or errno == EWOULDBLOCK) ) {
+    return 0;
+  }
+
+  SystemCall( "recvmmsg", count );
+
+  for ( int i = 0; i < count; i++ ) {
+    mmsghdr & message = batch.headers_[ i ];
+
+    /* make sure we got the whole datagram */
+    if ( message.msg_hdr.msg_flags & MSG_TRUNC ) {
+      throw runtime_error( "recvmmsg (oversized datagram)" );
+    } else if ( message.msg_hdr.msg_flags ) {
+      throw runtime_error( "recvmmsg (unhandled flag)" );
+    }
+
+    const Address source( batch.addresses_[ i ], message.msg_hdr.msg_namelen );
+    const control_info control = parse_control( message.msg_hdr );
+    char * const payload = &batch.payloads_[ i * batch.mtu_ ];
+
+    /* split a GRO super-buffer back into the datagrams that were sent */
+    const size_t segment_size = control.segment_size ? control.segment_size : message.msg_len;
+    size_t offset = 0;
+    do {
+      const size_t length = min<size_t>( segment_size, message.msg_len - offset );
+      batch.datagrams_.push_back( { source, control.timestamp, payload + offset, length } );
+      offset += length;
+    } while ( offset < message.msg_len );
+  }
+
+  return batch.size();
+}
+
 /* send datagram to specified address */
 void UDPSocket::sendto( const Address & destination, const string & payload )
 {
+  sendto( destination, payload.data(), payload.size() );
+}
+
+void UDPSocket::sendto( const Address & destination, const char * const payload, const size_t length )
+{
+  LatencyTimer timer( Latency::Syscall );
   const ssize_t bytes_sent =
     SystemCall( "sendto", ::sendto( fd_num(),
-				    payload.data(),
-				    payload.size(),
+				    payload,
+				    length,
 				    0,
 				    &destination.to_sockaddr(),
 				    destination.size() ) );
 
   register_write();
 
-  if ( size_t( bytes_sent ) != payload.size() ) {
+  if ( size_t( bytes_sent ) != length ) {
     throw runtime_error( "datagram payload too big for sendto()" );
   }
 }
@@ -157,6 +294,7 @@ void UDPSocket::sendto( const Address & destination, const string & payload )
 /* send datagram to connected address */
 void UDPSocket::send( const string & payload )
 {
+  LatencyTimer timer( Latency::Syscall );
   const ssize_t bytes_sent =
     SystemCall( "send", ::send( fd_num(),
 				payload.data(),
@@ -170,6 +308,143 @@ void UDPSocket::send( const string & payload )
   }
 }
 
+/* allocate buffers for a batch of datagrams up to mtu bytes each */
+UDPSocket::SendBatch::SendBatch( const size_t capacity, const size_t mtu )
+  : buffer_( capacity * mtu ),
+    used_( 0 ),
+    iovecs_(),
+    txtimes_(),
+    message_iovecs_( capacity ),
+    controls_( capacity * CONTROL_SIZE ),
+    headers_( capacity )
+{
+  if ( capacity == 0 ) {
+    throw runtime_error( "SendBatch capacity must be positive" );
+  }
+
+  iovecs_.reserve( capacity );
+  txtimes_.reserve( capacity );
+}
+
+/* is there room to stage another datagram of this length? */
+bool UDPSocket::SendBatch::has_room( const size_t length ) const
+{
+  return iovecs_.size() < capacity() and used_ + length <= buffer_.size();
+}
+
+/* reserve the next datagram and return where to write its contents */
+char * UDPSocket::SendBatch::stage( const size_t length, const uint64_t txtime_ns )
+{
+  if ( not has_room( length ) ) {
+    throw runtime_error( "SendBatch is full" );
+  }
+
+  char * const ret = &buffer_[ used_ ];
+  iovecs_.push_back( { ret, length } );
+  txtimes_.push_back( txtime_ns );
+  used_ += length;
+
+  return ret;
+}
+
+/* forget all staged datagrams */
+void UDPSocket::SendBatch::clear( void )
+{
+  iovecs_.clear();
+  txtimes_.clear();
+  used_ = 0;
+}
+
+/* send every staged datagram to connected address (then clear the batch) */
+void UDPSocket::send_batch( SendBatch & batch )
+{
+  size_t message_count = 0;
+
+  for ( size_t i = 0; i < batch.size(); message_count++ ) {
+    iovec & message_iovec = batch.message_iovecs_[ message_count ];
+    message_iovec = batch.iovecs_[ i ];
+
+    msghdr & header = batch.headers_[ message_count ].msg_hdr;
+    zero( header );
+
+    header.msg_iov = &message_iovec;
+    header.msg_iovlen = 1;
+
+    /* with GSO, glue on the following datagrams of the same size and
+       release time (they are already contiguous in the batch's buffer) */
+    const size_t segment_size = message_iovec.iov_len;
+    const uint64_t txtime_ns = batch.txtimes_[ i ];
+    size_t segments = 1;
+    i++;
+
+    while ( gso_
+	    and i < batch.size()
+	    and batch.length( i ) == segment_size
+	    and batch.txtimes_[ i ] == txtime_ns
+	    and segments < GSO_MAX_SEGMENTS
+	    and message_iovec.iov_len + segment_size <= GSO_MAX_BYTES ) {
+      message_iovec.iov_len += segment_size;
+      segments++;
+      i++;
+    }
+
+    if ( segments == 1 and txtime_ns == 0 ) {
+      continue;
+    }
+
+    header.msg_control = &batch.controls_[ message_count * SendBatch::CONTROL_SIZE ];
+    header.msg_controllen = SendBatch::CONTROL_SIZE;
+    memset( header.msg_control, 0, header.msg_controllen );
+    size_t control_length = 0;
+    cmsghdr * hdr = CMSG_FIRSTHDR( &header );
+
+    if ( segments > 1 ) {
+      hdr->cmsg_level = SOL_UDP;
+      hdr->cmsg_type = UDP_SEGMENT;
+      hdr->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+
+      const uint16_t gso_size = segment_size;
+      memcpy( CMSG_DATA( hdr ), &gso_size, sizeof( gso_size ) );
+
+      control_length += CMSG_SPACE( sizeof( gso_size ) );
+      hdr = CMSG_NXTHDR( &header, hdr );
+    }
+
+    if ( txtime_ns ) {
+      hdr->cmsg_level = SOL_SOCKET;
+      hdr->cmsg_type = SCM_TXTIME;
+      hdr->cmsg_len = CMSG_LEN( sizeof( txtime_ns ) );
+      memcpy( CMSG_DATA( hdr ), &txtime_ns, sizeof( txtime_ns ) );
+
+      control_length += CMSG_SPACE( sizeof( txtime_ns ) );
+    }
+
+    header.msg_controllen = control_length;
+  }
+
+  /* sendmmsg may stop short, so keep going until everything is out */
+  size_t sent = 0;
+  while ( sent < message_count ) {
+    LatencyTimer timer( Latency::Syscall );
+    const int count = SystemCall( "sendmmsg",
+				  sendmmsg( fd_num(), &batch.headers_[ sent ],
+					    message_count - sent, 0 ) );
+
+    register_write();
+
+    for ( int i = 0; i < count; i++ ) {
+      const mmsghdr & message = batch.headers_[ sent + i ];
+      if ( message.msg_len != message.msg_hdr.msg_iov->iov_len ) {
+	throw runtime_error( "datagram payload too big for sendmmsg()" );
+      }
+    }
+
+    sent += count;
+  }
+
+  batch.clear();
+}
+
 /* mark the socket as listening for incoming connections */
 void TCPSocket::listen( const int backlog )
 {
@@ -197,8 +472,63 @@ void Socket::set_reuseaddr( void )
   setsockopt( SOL_SOCKET, SO_REUSEADDR, int( true ) );
 }
 
+void Socket::set_reuseport( void )
+{
+  setsockopt( SOL_SOCKET, SO_REUSEPORT, int( true ) );
+}
+
+void Socket::set_incoming_cpu( const int cpu )
+{
+  setsockopt( SOL_SOCKET, SO_INCOMING_CPU, cpu );
+}
+
+/* classic BPF: return (receiving CPU) % group_size as the index of the socket */
+void Socket::steer_by_cpu( const unsigned int group_size )
+{
+  if ( group_size == 0 ) {
+    throw runtime_error( "steer_by_cpu: empty group" );
+  }
+
+  sock_filter code[] = {
+    { BPF_LD | BPF_W | BPF_ABS, 0, 0, uint32_t( SKF_AD_OFF + SKF_AD_CPU ) },
+    { BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size },
+    { BPF_RET | BPF_A, 0, 0, 0 },
+  };
+
+  sock_fprog program;
+  zero( program );
+  program.len = sizeof( code ) / sizeof( code[ 0 ] );
+  program.filter = code;
+
+  setsockopt( SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, program );
+}
+
 /* turn on timestamps on receipt */
 void UDPSocket::set_timestamps( void )
 {
   setsockopt( SOL_SOCKET, SO_TIMESTAMPNS, int( true ) );
 }
+
+/* let send_batch() use UDP segmentation offload */
+void UDPSocket::set_gso( void )
+{
+  /* segment size is given per send, so this just checks the kernel supports it */
+  setsockopt( SOL_UDP, UDP_SEGMENT, int( 0 ) );
+  gso_ = true;
+}
+
+/* honor per-datagram release times */
+void UDPSocket::set_txtime( void )
+{
+  sock_txtime config;
+  zero( config );
+  config.clockid = CLOCK_MONOTONIC;
+
+  setsockopt( SOL_SOCKET, SO_TXTIME, config );
+}
+
+/* let the kernel coalesce incoming datagrams */
+void UDPSocket::set_gro( void )
+{
+  setsockopt( SOL_UDP, UDP_GRO, int( true ) );
+}
@@ -2,6 +2,9 @@
 #define SOCKET_HH
 
 #include <functional>
+#include <vector>
+
+#include <sys/socket.h>
 
 #include "address.hh"
 #include "file_descriptor.hh"
@@ -38,31 +41,158 @@ public:
 
   /* allow local address to be reused sooner, at the cost of some robustness */
   void set_reuseaddr( void );
+
+  /* let several sockets bind the same address and port, with the kernel
+     spreading incoming traffic among them (by flow hash unless steered) */
+  void set_reuseport( void );
+
+  /* hint that this socket is served on the given CPU (Linux SO_INCOMING_CPU) */
+  void set_incoming_cpu( const int cpu );
+
+  /* deliver to the member of this socket's SO_REUSEPORT group whose index is
+     the CPU that received the packet, modulo group_size (Linux SO_ATTACH_REUSEPORT_CBPF) */
+  void steer_by_cpu( const unsigned int group_size );
 };
 
 /* UDP socket */
 class UDPSocket : public Socket
 {
+private:
+  bool gso_;
+
 public:
-  UDPSocket() : Socket( AF_INET6, SOCK_DGRAM ) {}
+  UDPSocket() : Socket( AF_INET6, SOCK_DGRAM ), gso_( false ) {}
 
   struct received_datagram {
     Address source_address;
-    uint64_t timestamp;
+    uint64_t timestamp; /* microseconds (see timestamp.hh) */
     std::string payload;
   };
 
-  /* receive datagram, timestamp, and where it came from */
+  /* a datagram received in place into a RecvBatch's buffers
+     (one per segment when the kernel coalesced them with GRO) */
+  struct batch_datagram {
+    Address source_address;
+    uint64_t timestamp; /* microseconds (see timestamp.hh) */
+    char * payload;
+    size_t length;
+  };
+
+  /* reusable, preallocated buffers for receiving many datagrams per syscall */
+  class RecvBatch
+  {
+    friend class UDPSocket;
+
+  private:
+    size_t mtu_;
+
+    std::vector<char> payloads_;
+    std::vector<char> controls_;
+    std::vector<Address::raw> addresses_;
+    std::vector<iovec> iovecs_;
+    std::vector<mmsghdr> headers_;
+
+    std::vector<batch_datagram> datagrams_;
+
+    /* space for the ancillary data of one datagram */
+    const static size_t CONTROL_SIZE = 256;
+
+  public:
+    RecvBatch( const size_t capacity = 32, const size_t mtu = 65536 );
+
+    /* maximum number of datagrams per recv_batch() */
+    size_t capacity( void ) const { return headers_.size(); }
+
+    /* datagrams from the most recent recv_batch() */
+    size_t size( void ) const { return datagrams_.size(); }
+    const batch_datagram & operator[]( const size_t i ) const { return datagrams_[ i ]; }
+    batch_datagram & operator[]( const size_t i ) { return datagrams_[ i ]; }
+
+    std::vector<batch_datagram>::const_iterator begin( void ) const { return datagrams_.begin(); }
+    std::vector<batch_datagram>::const_iterator end( void ) const { return datagrams_.end(); }
+    std::vector<batch_datagram>::iterator begin( void ) { return datagrams_.begin(); }
+    std::vector<batch_datagram>::iterator end( void ) { return datagrams_.end(); }
+  };
+
+  /* reusable, preallocated buffers for sending many datagrams per syscall */
+  class SendBatch
+  {
+    friend class UDPSocket;
+
+  private:
+    std::vector<char> buffer_; /* staged datagrams, packed back to back */
+    size_t used_;
+
+    std::vector<iovec> iovecs_;
+    std::vector<uint64_t> txtimes_; /* per datagram, 0 if none */
+
+    /* what actually goes to sendmmsg (one entry per GSO super-buffer) */
+    std::vector<iovec> message_iovecs_;
+    std::vector<char> controls_;
+    std::vector<mmsghdr> headers_;
+
+    /* space for the ancillary data of one message */
+    const static size_t CONTROL_SIZE = 64;
+
+  public:
+    SendBatch( const size_t capacity = 1024, const size_t mtu = 1500 );
+
+    /* maximum number of datagrams per send_batch() */
+    size_t capacity( void ) const { return headers_.size(); }
+
+    /* number of datagrams staged so far */
+    size_t size( void ) const { return iovecs_.size(); }
+    bool empty( void ) const { return iovecs_.empty(); }
+
+    /* is there room to stage another datagram of this length? */
+    bool has_room( const size_t length ) const;
+
+    /* reserve the next datagram and return where to write its contents
+       (with SO_TXTIME on, txtime_ns is when the kernel should release it) */
+    char * stage( const size_t length, const uint64_t txtime_ns = 0 );
+
+    /* contents of the ith staged datagram */
+    char * datagram( const size_t i ) { return static_cast<char *>( iovecs_[ i ].iov_base ); }
+    size_t length( const size_t i ) const { return iovecs_[ i ].iov_len; }
+    uint64_t txtime( const size_t i ) const { return txtimes_[ i ]; }
+
+    /* forget all staged datagrams */
+    void clear( void );
+  };
+
+  /* receive datagram, timestamp, and where it came from
+     (not GRO-aware: use recv_batch() on sockets with GRO turned on) */
   received_datagram recv( void );
 
+  /* receive up to batch.capacity() datagrams with one syscall, returning the
+     number received (if wait is false, returns 0 when nothing is waiting
+     instead of blocking until at least one datagram is available) */
+  size_t recv_batch( RecvBatch & batch, const bool wait = true );
+
   /* send datagram to specified address */
   void sendto( const Address & peer, const std::string & payload );
+  void sendto( const Address & peer, const char * const payload, const size_t length );
 
   /* send datagram to connected address */
   void send( const std::string & payload );
 
+  /* send every staged datagram to connected address (then clear the batch) */
+  void send_batch( SendBatch & batch );
+
   /* turn on timestamps on receipt */
   void set_timestamps( void );
+
+  /* let send_batch() hand runs of equal-sized datagrams to the kernel
+     as one super-buffer to be segmented (Linux UDP_SEGMENT) */
+  void set_gso( void );
+
+  /* let the kernel coalesce incoming datagrams (Linux UDP_GRO);
+     recv_batch() splits them back up */
+  void set_gro( void );
+
+  /* honor per-datagram release times (CLOCK_MONOTONIC) given to SendBatch::stage()
+     (Linux SO_TXTIME; only enforced by a pacing qdisc such as fq or etf) */
+  void set_txtime( void );
 };
 
 /* TCP socket */
@@ -0,0 +1,63 @@
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "timerfd.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* nanoseconds per second */
+static const uint64_t BILLION = 1000000000;
+
+TimerFD::TimerFD()
+  : FileDescriptor( SystemCall( "timerfd_create",
+				timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) )
+{}
+
+/* become readable at deadline (nanoseconds on CLOCK_MONOTONIC) */
+void TimerFD::arm( const uint64_t deadline_ns )
+{
+  itimerspec spec;
+  zero( spec );
+
+  /* an all-zero it_value would disarm the timer instead */
+  spec.it_value.tv_sec = deadline_ns / BILLION;
+  spec.it_value.tv_nsec = deadline_ns % BILLION;
+  if ( deadline_ns == 0 ) {
+    spec.it_value.tv_nsec = 1;
+  }
+
+  SystemCall( "timerfd_settime", timerfd_settime( fd_num(), TFD_TIMER_ABSTIME, &spec, nullptr ) );
+}
+
+/* don't become readable */
+void TimerFD::disarm( void )
+{
+  itimerspec spec;
+  zero( spec );
+
+  SystemCall( "timerfd_settime", timerfd_settime( fd_num(), 0, &spec, nullptr ) );
+}
+
+/* read (and reset) the number of expirations, or 0 if it hasn't fired */
+uint64_t TimerFD::expirations( void )
+{
+  uint64_t count = 0;
+
+  const ssize_t bytes_read = ::read( fd_num(), &count, sizeof( count ) );
+
+  register_read();
+
+  /* the timer may have been re-armed after poll saw it fire */
+  if ( bytes_read < 0 and errno == EAGAIN ) {
+    return 0;
+  }
+
+  SystemCall( "read", bytes_read );
+
+  if ( bytes_read != sizeof( count ) ) {
+    throw runtime_error( "timerfd read returned wrong size" );
+  }
+
+  return count;
+}
@@ -0,0 +1,24 @@
+#ifndef TIMERFD_HH
+#define TIMERFD_HH
+
+#include <cstdint>
+
+#include "file_descriptor.hh"
+
+/* Linux timerfd: a file descriptor that becomes readable at a deadline */
+class TimerFD : public FileDescriptor
+{
+public:
+  TimerFD();
+
+  /* become readable at deadline (nanoseconds on CLOCK_MONOTONIC) */
+  void arm( const uint64_t deadline_ns );
+
+  /* don't become readable */
+  void disarm( void );
+
+  /* read (and reset) the number of expirations, or 0 if it hasn't fired */
+  uint64_t expirations( void );
+};
+
+#endif /* TIMERFD_HH */
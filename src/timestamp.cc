@@ -1,8 +1,21 @@
+#include <algorithm>
 #include <ctime>
+#include <fstream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
 
 #include "timestamp.hh"
 #include "util.hh"
 
+using namespace std;
+
+/* nanoseconds per microsecond */
+static const uint64_t THOUSAND = 1000;
+
 /* nanoseconds per millisecond */
 static const uint64_t MILLION = 1000000;
 
@@ -10,27 +23,190 @@ static const uint64_t MILLION = 1000000;
 static const uint64_t BILLION = 1000 * MILLION;
 
 /* helper functions */
-static timespec current_time( void )
+static timespec current_time( const clockid_t clock )
 {
   timespec ret;
-  SystemCall( "clock_gettime", clock_gettime( CLOCK_REALTIME, &ret ) );
+  SystemCall( "clock_gettime", clock_gettime( clock, &ret ) );
   return ret;
 }
 
-static uint64_t timestamp_ms_raw( const timespec & ts )
+static uint64_t timestamp_ns_raw( const timespec & ts )
+{
+  return ts.tv_sec * BILLION + ts.tv_nsec;
+}
+
+/* Raw CLOCK_MONOTONIC in nanoseconds */
+uint64_t monotonic_ns( void )
+{
+  return timestamp_ns_raw( current_time( CLOCK_MONOTONIC ) );
+}
+
+/* the start of the program (set before main, so that kernel
+   timestamps of datagrams that arrive early are still after it) */
+static const uint64_t EPOCH = monotonic_ns();
+
+static uint64_t epoch_ns( void )
+{
+  return EPOCH;
+}
+
+/* how often the TSC is calibrated against CLOCK_MONOTONIC again, and the
+   wall clock's offset measured again, so neither drifts from the kernel's
+   timestamps (which are on those clocks) */
+static const uint64_t RECALIBRATE_NS = BILLION;
+
+/* TSC calibration (if in use): a CLOCK_MONOTONIC reading and the TSC at it,
+   and the rate until the next one. Each thread recalibrates its own copy. */
+struct TSCCalibration
+{
+  uint64_t base_ticks;
+  uint64_t base_ns;
+  double ns_per_tick;
+};
+
+static bool tsc_in_use = false;
+static TSCCalibration tsc_initial = { 0, 0, 0 };
+static thread_local TSCCalibration tsc = { 0, 0, 0 };
+static thread_local uint64_t tsc_last_ns = 0;
+
+#ifdef HAVE_TSC
+/* anchor the TSC to CLOCK_MONOTONIC again, at the rate since the last anchor */
+static uint64_t recalibrate_tsc( void )
+{
+  const uint64_t now_ns = monotonic_ns() - epoch_ns();
+  const uint64_t now_ticks = __rdtsc();
+
+  if ( now_ticks > tsc.base_ticks and now_ns > tsc.base_ns ) {
+    tsc.ns_per_tick = double( now_ns - tsc.base_ns ) / (now_ticks - tsc.base_ticks);
+  }
+  tsc.base_ticks = now_ticks;
+  tsc.base_ns = now_ns;
+
+  return now_ns;
+}
+#endif
+
+/* Current time in nanoseconds since the start of the program */
+uint64_t timestamp_ns( void )
+{
+#ifdef HAVE_TSC
+  if ( tsc_in_use ) {
+    if ( tsc.ns_per_tick == 0 ) {
+      tsc = tsc_initial;
+    }
+
+    const uint64_t elapsed_ns = (__rdtsc() - tsc.base_ticks) * tsc.ns_per_tick;
+    const uint64_t now_ns = elapsed_ns < RECALIBRATE_NS
+      ? tsc.base_ns + elapsed_ns
+      : recalibrate_tsc();
+
+    /* a new rate may put the clock a little behind where the old one had it */
+    tsc_last_ns = max( tsc_last_ns, now_ns );
+    return tsc_last_ns;
+  }
+#endif
+
+  return monotonic_ns() - epoch_ns();
+}
+
+uint64_t timestamp_us( void )
 {
-  const uint64_t nanos = ts.tv_sec * BILLION + ts.tv_nsec;
-  return nanos / MILLION;
+  return timestamp_ns() / THOUSAND;
 }
 
-/* Current time in milliseconds since the start of the program */
 uint64_t timestamp_ms( void )
 {
-  return timestamp_ms( current_time() );
+  return timestamp_ns() / MILLION;
+}
+
+/* how far the wall clock is ahead of the monotonic one (so an NTP step
+   moves the offset, not our timestamps), the wall-clock time it was
+   measured at, and the newest stamp converted since */
+static thread_local uint64_t realtime_offset_ns = 0;
+static thread_local uint64_t realtime_offset_at_ns = 0;
+static thread_local uint64_t last_realtime_ns = 0;
+
+/* Convert a CLOCK_REALTIME timestamp to the same clock */
+uint64_t timestamp_ns( const timespec & ts )
+{
+  const uint64_t realtime_ns = timestamp_ns_raw( ts );
+
+  /* measure the offset again once the stamps are a second past the last
+     measurement, or if they go backwards (the wall clock was stepped back);
+     a stamp from before the measurement is fine, since the kernel stamps
+     datagrams before we get to them */
+  if ( realtime_offset_at_ns == 0
+       or realtime_ns < last_realtime_ns
+       or (realtime_ns > realtime_offset_at_ns
+	   and realtime_ns - realtime_offset_at_ns > RECALIBRATE_NS) ) {
+    const uint64_t realtime_now = timestamp_ns_raw( current_time( CLOCK_REALTIME ) );
+    realtime_offset_ns = realtime_now - monotonic_ns();
+    realtime_offset_at_ns = realtime_now;
+  }
+  last_realtime_ns = realtime_ns;
+
+  return realtime_ns - realtime_offset_ns - epoch_ns();
+}
+
+uint64_t timestamp_us( const timespec & ts )
+{
+  return timestamp_ns( ts ) / THOUSAND;
 }
 
 uint64_t timestamp_ms( const timespec & ts )
 {
-  const static uint64_t EPOCH = timestamp_ms_raw( current_time() );
-  return timestamp_ms_raw( ts ) - EPOCH;
+  return timestamp_ns( ts ) / MILLION;
+}
+
+/* does /proc/cpuinfo say the TSC ticks at a constant rate, even in deep sleep? */
+static bool tsc_is_invariant( void )
+{
+  ifstream cpuinfo( "/proc/cpuinfo" );
+  string line;
+  while ( getline( cpuinfo, line ) ) {
+    if ( line.compare( 0, 5, "flags" ) == 0 ) {
+      return line.find( " constant_tsc" ) != string::npos
+	and line.find( " nonstop_tsc" ) != string::npos;
+    }
+  }
+
+  return false;
+}
+
+/* Read the clock from the TSC instead of calling clock_gettime */
+bool use_tsc_clock( void )
+{
+#ifdef HAVE_TSC
+  if ( tsc_in_use ) {
+    return true;
+  }
+
+  if ( not tsc_is_invariant() ) {
+    return false;
+  }
+
+  /* count ticks over a few milliseconds of CLOCK_MONOTONIC */
+  const uint64_t start_ns = monotonic_ns();
+  const uint64_t start_ticks = __rdtsc();
+
+  uint64_t end_ns;
+  do {
+    end_ns = monotonic_ns();
+  } while ( end_ns - start_ns < 10 * MILLION );
+  const uint64_t end_ticks = __rdtsc();
+
+  if ( end_ticks <= start_ticks ) {
+    return false;
+  }
+
+  tsc_initial.ns_per_tick = double( end_ns - start_ns ) / (end_ticks - start_ticks);
+  tsc_initial.base_ticks = end_ticks;
+  tsc_initial.base_ns = end_ns - epoch_ns();
+  tsc = tsc_initial;
+  tsc_in_use = true;
+
+  return true;
+#else
+  return false;
+#endif
 }
@@ -4,8 +4,27 @@
 #include <ctime>
 #include <cstdint>
 
-/* Current time in milliseconds since the start of the program */
+/* All timestamps are on CLOCK_MONOTONIC (which NTP can't step),
+   counted from the start of the program */
+
+/* Current time in milliseconds, microseconds, or nanoseconds */
 uint64_t timestamp_ms( void );
+uint64_t timestamp_us( void );
+uint64_t timestamp_ns( void );
+
+/* Convert a CLOCK_REALTIME timestamp (e.g. from SO_TIMESTAMPNS)
+   to the same clock */
 uint64_t timestamp_ms( const timespec & ts );
+uint64_t timestamp_us( const timespec & ts );
+uint64_t timestamp_ns( const timespec & ts );
+
+/* Raw CLOCK_MONOTONIC in nanoseconds (for timerfd and SO_TXTIME deadlines) */
+uint64_t monotonic_ns( void );
+
+/* Read the clock from the CPU's invariant TSC, calibrated against
+   CLOCK_MONOTONIC (again every second), instead of calling clock_gettime.
+   Returns false (and changes nothing) if the TSC isn't usable.
+   Call before starting any threads. */
+bool use_tsc_clock( void );
 
 #endif /* TIMESTAMP_HH */